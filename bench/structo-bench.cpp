@@ -0,0 +1,345 @@
+# include "src/indexer/contents-index-merger.hpp"
+# include "indexer/dynamic-contents.hpp"
+# include "indexer/static-contents.hpp"
+# include "storage/posix-fs.hpp"
+# include "context/x-contents.hpp"
+# include "context/processor.hpp"
+# include "queries/builder.hpp"
+# include "queries/parser.hpp"
+# include "rankers.hpp"
+# include <DeliriX/text-API.hpp>
+# include <functional>
+# include <chrono>
+# include <random>
+# include <vector>
+# include <string>
+# include <cstdio>
+
+using namespace structo;
+
+# define  STORAGE_DIR "/var/tmp/"
+
+ /*
+  * structo-bench - reproducible benchmarks of indexing, commit, merge and search
+  *
+  * The corpus is generated from the seed: the same options produce the same documents
+  * and the same queries, so the results of different versions may be compared. The
+  * results are printed to stdout as JSON.
+  */
+
+struct Options
+{
+  unsigned    nDocs = 20000;          // documents in the corpus
+  unsigned    nDict = 50000;          // vocabulary size
+  unsigned    nWord = 200;            // words per document
+  unsigned    nRuns = 1000;           // queries per search test
+  unsigned    uSeed = 1;
+  std::string stDir = STORAGE_DIR "structo-bench";
+};
+
+struct Result
+{
+  std::string name;
+  size_t      count;
+  double      seconds;
+};
+
+static  context::FieldManager fieldMan;
+
+ /*
+  * Corpus
+  *
+  * Synthetic documents with Zipf-distributed words of the generated vocabulary.
+  */
+class Corpus
+{
+public:
+  Corpus( const Options& );
+
+  auto  GetText( unsigned ) const -> const std::string&;
+  auto  GetWord() -> const std::string&;
+  auto  GetRare() -> const std::string&;
+
+protected:
+  std::vector<std::string>  vocabulary;
+  std::vector<double>       cumulative;
+  std::vector<std::string>  documents;
+  std::mt19937              generator;
+
+};
+
+Corpus::Corpus( const Options& opts ): generator( opts.uSeed )
+{
+  static const char*  syllables[] = { "ka", "lo", "mi", "ne", "ru", "so", "ta", "vi", "be", "da", "go", "zu" };
+
+  auto  sum = 0.0;
+
+// create the vocabulary
+  for ( unsigned i = 0; i != opts.nDict; ++i )
+  {
+    auto  word = std::string();
+
+    for ( auto n = i + 1; n != 0; n /= 12 )
+      word += syllables[n % 12];
+
+    vocabulary.push_back( word );
+    cumulative.push_back( sum += 1.0 / (i + 1) );
+  }
+
+// create the documents
+  for ( unsigned i = 0; i != opts.nDocs; ++i )
+  {
+    auto  text = std::string();
+
+    for ( unsigned w = 0; w != opts.nWord; ++w )
+      (text += w != 0 ? " " : "") += GetWord();
+
+    documents.push_back( std::move( text ) );
+  }
+}
+
+auto  Corpus::GetText( unsigned i ) const -> const std::string&
+{
+  return documents[i];
+}
+
+auto  Corpus::GetWord() -> const std::string&
+{
+  auto  select = std::uniform_real_distribution<double>( 0.0, cumulative.back() )( generator );
+
+  return vocabulary[std::lower_bound( cumulative.begin(), cumulative.end(), select ) - cumulative.begin()];
+}
+
+auto  Corpus::GetRare() -> const std::string&
+{
+  return vocabulary[std::uniform_int_distribution<size_t>( vocabulary.size() / 100, vocabulary.size() - 1 )( generator )];
+}
+
+template <class Action>
+auto  Measure( std::vector<Result>& output, const char* name, size_t count, Action action ) -> decltype(action())
+{
+  auto  tstart = std::chrono::steady_clock::now();
+  auto  result = action();
+
+  output.push_back( { name, count, std::chrono::duration<double>( std::chrono::steady_clock::now() - tstart ).count() } );
+
+  return result;
+}
+
+void  CleanFiles( const std::string& mask )
+{
+  auto  syscmd = "rm -f " + mask + "* 2>/dev/null";
+
+  if ( system( syscmd.c_str() ) != 0 )
+    (void)NULL;
+}
+
+auto  CreateIndex( const std::string& path, unsigned maxEntities ) -> mtc::api<IContentsIndex>
+{
+  return indexer::dynamic::Index()
+    .Set( indexer::dynamic::Settings().SetMaxEntities( maxEntities + 1 ) )
+    .Set( storage::posixFS::CreateSink( storage::posixFS::StoragePolicies::Open( path ) ) ).Create();
+}
+
+void  PrintResults( FILE* output, const Options& opts, const std::vector<Result>& results )
+{
+  fprintf( output, "{\n"
+    "  \"corpus\": { \"documents\": %u, \"vocabulary\": %u, \"words\": %u, \"queries\": %u, \"seed\": %u },\n"
+    "  \"results\": [", opts.nDocs, opts.nDict, opts.nWord, opts.nRuns, opts.uSeed );
+
+  for ( auto& next: results )
+  {
+    fprintf( output, "%s\n    { \"name\": \"%s\", \"count\": %zu, \"seconds\": %.6f, \"per-second\": %.2f }",
+      &next == results.data() ? "" : ",", next.name.c_str(), next.count, next.seconds,
+      next.seconds > 0 ? next.count / next.seconds : 0.0 );
+  }
+
+  fprintf( output, "\n  ]\n}\n" );
+}
+
+int   RunBench( const Options& opts )
+{
+  auto  lp = context::Processor();
+  auto  corpus = Corpus( opts );
+  auto  output = std::vector<Result>();
+  auto  mini = std::vector<context::Contents>();
+  auto  rich = std::vector<context::Contents>();
+
+// prepare the indexable contents out of measurements
+  for ( unsigned i = 0; i != opts.nDocs; ++i )
+  {
+    auto  image = lp.MakeImage( DeliriX::Text{ corpus.GetText( i ).c_str() } );
+
+    mini.push_back( MiniContents( image ) );
+    rich.push_back( RichContents( image, fieldMan ) );
+  }
+
+// index two halves of the corpus with mini contents
+  auto  indexA = CreateIndex( opts.stDir + "-a", opts.nDocs );
+  auto  indexB = CreateIndex( opts.stDir + "-b", opts.nDocs );
+
+  Measure( output, "dynamic/set-entity/mini", opts.nDocs, [&]()
+    {
+      for ( unsigned i = 0; i != opts.nDocs; ++i )
+        (i % 2 == 0 ? indexA : indexB)->SetEntity( "doc-" + std::to_string( i ), mini[i] );
+      return 0;
+    } );
+
+// commit the halves to static indices
+  auto  staticA = Measure( output, "commit/static", opts.nDocs / 2, [&]()
+    {  return indexer::static_::Index().Create( indexA->Commit() );  } );
+  auto  staticB = indexer::static_::Index().Create( indexB->Commit() );
+
+  indexA = indexB = nullptr;
+
+// merge the static indices
+  auto  merged = Measure( output, "merge/static", opts.nDocs, [&]()
+    {
+      auto  outSink = storage::posixFS::CreateSink( storage::posixFS::StoragePolicies::Open( opts.stDir + "-m" ) );
+
+      indexer::fusion::ContentsMerger()
+        .Set( outSink )
+        .Set( std::vector<mtc::api<IContentsIndex>>{ staticA, staticB } )();
+
+      return indexer::static_::Index().Create( outSink->Commit() );
+    } );
+
+// list some keys and check the key blocks access
+  auto  keyset = std::vector<std::string>();
+
+  if ( auto list = merged->ListContents( "" ) )
+    for ( auto key = list->Curr(); !key.empty() && keyset.size() != opts.nRuns; key = list->Next() )
+      keyset.push_back( key );
+
+  Measure( output, "static/get-key-block", keyset.size(), [&]()
+    {
+      auto  nfound = size_t(0);
+
+      for ( auto& key: keyset )
+        if ( merged->GetKeyBlock( key ) != nullptr )
+          ++nfound;
+      return nfound;
+    } );
+
+  Measure( output, "static/find-entities", keyset.size(), [&]()
+    {
+      auto  nfound = size_t(0);
+
+      for ( auto& key: keyset )
+        if ( auto block = merged->GetKeyBlock( key ) )
+          for ( auto next = block->Find( 0 ); next.uEntity != uint32_t(-1); next = block->Find( next.uEntity + 1 ) )
+            ++nfound;
+      return nfound;
+    } );
+
+// evaluate mini queries
+  auto  miniReq = std::vector<std::string>();
+
+  for ( unsigned i = 0; i != opts.nRuns; ++i )
+    miniReq.push_back( corpus.GetWord() + (i % 2 == 0 ? " & " : " | ") + corpus.GetRare() );
+
+  Measure( output, "query/mini/bm25-top-10", miniReq.size(), [&]()
+    {
+      auto  nfound = size_t(0);
+
+      for ( auto& req: miniReq )
+        nfound += rankers::BM25TopK( queries::BuildMiniQuery( merged, lp, queries::ParseQuery( req ) ), 10 ).size();
+      return nfound;
+    } );
+
+  staticA = staticB = merged = nullptr;
+
+// index the corpus with rich contents and evaluate rich queries
+  auto  indexR = CreateIndex( opts.stDir + "-r", opts.nDocs );
+
+  Measure( output, "dynamic/set-entity/rich", opts.nDocs, [&]()
+    {
+      for ( unsigned i = 0; i != opts.nDocs; ++i )
+        indexR->SetEntity( "doc-" + std::to_string( i ), rich[i] );
+      return 0;
+    } );
+
+  auto  staticR = indexer::static_::Index().Create( indexR->Commit() );
+  auto  richReq = std::vector<std::string>();
+
+  indexR = nullptr;
+
+  for ( unsigned i = 0; i != opts.nRuns; ++i )
+    richReq.push_back( corpus.GetWord() + " " + corpus.GetWord() );
+
+  Measure( output, "query/rich/evaluate", richReq.size(), [&]()
+    {
+      auto  nfound = size_t(0);
+
+      for ( auto& req: richReq )
+      {
+        auto  query = queries::BuildRichQuery( queries::ParseQuery( req ), {}, staticR, lp, fieldMan );
+
+        if ( query != nullptr )
+          for ( auto docid = query->SearchDoc( 1 ); docid != uint32_t(-1); docid = query->SearchDoc( docid + 1 ) )
+          {
+            auto& tuples = query->GetTuples( docid );
+
+            if ( tuples.dwMode != tuples.None && rankers::Rich( tuples ) > 0.0 )
+              ++nfound;
+          }
+      }
+      return nfound;
+    } );
+
+  staticR = nullptr;
+
+  for ( auto suffix: { "-a", "-b", "-m", "-r" } )
+    CleanFiles( opts.stDir + suffix );
+
+  return PrintResults( stdout, opts, output ), 0;
+}
+
+const char about[] = "structo-bench - structo indexing and search benchmarks\n"
+  "Usage: structo-bench [options]\n"
+  "\t-docs=N\tdocuments in the synthetic corpus, default 20000;\n"
+  "\t-dict=N\tvocabulary size, default 50000;\n"
+  "\t-words=N\twords per document, default 200;\n"
+  "\t-runs=N\tqueries per search test, default 1000;\n"
+  "\t-seed=N\tcorpus generator seed, default 1;\n"
+  "\t-path=P\ttemporary indices path prefix, default " STORAGE_DIR "structo-bench.\n"
+  "Results are printed to stdout as JSON.\n";
+
+int   main( int argc, char* argv[] )
+{
+  auto  opts = Options();
+
+  for ( auto i = 1; i < argc; ++i )
+  {
+    auto  arg = std::string( argv[i] );
+    auto  pos = arg.find( '=' );
+    auto  key = arg.substr( 0, pos );
+    auto  val = pos != std::string::npos ? arg.substr( pos + 1 ) : std::string();
+
+    if ( key == "-docs" && !val.empty() )   opts.nDocs = std::stoul( val );
+      else
+    if ( key == "-dict" && !val.empty() )   opts.nDict = std::stoul( val );
+      else
+    if ( key == "-words" && !val.empty() )  opts.nWord = std::stoul( val );
+      else
+    if ( key == "-runs" && !val.empty() )   opts.nRuns = std::stoul( val );
+      else
+    if ( key == "-seed" && !val.empty() )   opts.uSeed = std::stoul( val );
+      else
+    if ( key == "-path" && !val.empty() )   opts.stDir = val;
+      else
+    return fprintf( stdout, about ), 0;
+  }
+
+  if ( opts.nDocs < 2 || opts.nDict == 0 || opts.nWord == 0 )
+    return fprintf( stderr, "invalid corpus options\n" ), EINVAL;
+
+  try
+  {
+    return RunBench( opts );
+  }
+  catch ( const std::exception& xp )
+  {
+    return fprintf( stderr, "%s\n", xp.what() ), EFAULT;
+  }
+}
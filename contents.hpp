@@ -120,6 +120,20 @@ namespace structo
   {
     virtual auto  Get( int64_t ) const -> mtc::api<const mtc::IByteBuffer> = 0;
     virtual auto  Put( const void*, size_t ) -> int64_t = 0;
+
+   /*
+    * Copy( source, point )
+    *
+    * Stores the bundle of the source repository record and returns its position, or -1
+    * if there is no such record. The default one reads and puts the bundle; repositories
+    * of the same format may copy the stored record as is or refer the source record.
+    */
+    virtual auto  Copy( const IBundleRepo& source, int64_t point ) -> int64_t
+    {
+      auto  bundle = source.Get( point );
+
+      return bundle != nullptr ? Put( bundle->GetPtr(), bundle->GetLen() ) : -1;
+    }
   };
 
   struct IContentsIndex: mtc::Iface
@@ -8,6 +8,22 @@ namespace context {
   auto  LoadLemmatizer( const char*, const char* = nullptr ) -> mtc::api<ILemmatizer>;
   auto  LoadLemmatizer( const std::string&, const std::string& = {} ) -> mtc::api<ILemmatizer>;
 
+ /*
+  * CacheLemmatizer( module, maxWords )
+  *
+  * Wraps the module with the bounded concurrent cache of Lemmatize() results keyed
+  * by the word form and flags. The words follow Zipf's law, so a small cache saves
+  * most of the module calls. Wildcards() are passed to the module as is.
+  *
+  * The module has to be deterministic; cached modules are not wrapped twice.
+  */
+  enum: size_t
+  {
+    default_cache_size = 0x10000
+  };
+
+  auto  CacheLemmatizer( const mtc::api<ILemmatizer>&, size_t = default_cache_size ) -> mtc::api<ILemmatizer>;
+
 }};
 
 # endif // !__structo_context_lemmatiser_hpp__
@@ -7,6 +7,7 @@
 # include <moonycode/chartype.h>
 # include <moonycode/codes.h>
 # include <mtc/arbitrarymap.h>
+# include <functional>
 
 namespace structo {
 namespace context {
@@ -49,7 +50,29 @@ namespace context {
     auto  MakeImage( const ITextView&, const FieldHandler* = nullptr ) const -> Image;
     auto  WordBreak( const ITextView&, const FieldHandler* = nullptr ) const -> Image;
 
+   /*
+    * MakeImages( count, input, output, fields, threads )
+    *
+    * Creates the images of count documents on the pool of threads (0 - by hardware).
+    *
+    * input( n ) returns the text of the n-th document; output( n, image ) receives the
+    * image, is called on the worker thread and has to be thread-safe, for example, it
+    * may build the contents and pass it to IContentsIndex::SetEntity().
+    *
+    * Each thread reuses one image for all its documents, so the image is valid only
+    * within the output() call. The first exception thrown stops the batch and is
+    * rethrown to the caller.
+    */
+    void  MakeImages( size_t,
+      const std::function<const ITextView&( size_t )>&,
+      const std::function<void( size_t, const Image& )>&,
+      const FieldHandler* = nullptr, unsigned = 0 ) const;
+
   public:
+   /*
+    * The modules are wrapped with CacheLemmatizer(), so the repeated words are
+    * lemmatized once for both the documents and the queries.
+    */
     auto  AddModule( unsigned langId, const mtc::api<ILemmatizer>& ) -> Processor&;
     auto  Initialize( const mtc::span<const std::pair<unsigned, const mtc::api<ILemmatizer>>>& ) ->Processor&;
 
@@ -122,17 +145,23 @@ namespace context {
       const TextToken*  pword;
       unsigned          index;
     };
-    std::vector<StrRef>   items( image.tokens.size() );
-    StrRef*               plast = items.data();
-    std::vector<StrRef*>  itMap(
+  // the scratch buffers are kept by the thread for the next documents
+    thread_local std::vector<StrRef>   items;
+    thread_local std::vector<StrRef*>  itMap;
+
+    items.resize( std::max( items.size(), image.tokens.size() ) );
+    itMap.assign(
       image.tokens.size() < 2003 ? 3001 :
       image.tokens.size() < 8009 ? 12007 :
       image.tokens.size() < 16001 ? 20011 :
       image.tokens.size() < 28001 ? 32003 :
-      image.tokens.size() < 55001 ? 60013 : 90031 );
+      image.tokens.size() < 55001 ? 60013 : 90031, nullptr );
+
+    StrRef*               plast = items.data();
 
     image.lemmas.clear();
     image.lemmas.resize( image.tokens.size() );
+    image.lexbuf.clear();
     image.lexbuf.reserve( image.tokens.size() * 2 );
 
   // create words index
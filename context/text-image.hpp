@@ -291,6 +291,7 @@ namespace context {
     tokens.clear();
     markup.clear();
     lemmas.clear();
+    lexbuf.clear();
     clear_buf();
   }
 
@@ -8,7 +8,7 @@ namespace dynamic {
 
   struct Settings
   {
-    uint32_t  maxEntities = 60000;                /* */
+    uint32_t  maxEntities = 0;                    /* 0 - limited by maxAllocate only */
     uint32_t  maxAllocate = 256 * 1024 * 1024;    /* 256 meg */
 
   public:
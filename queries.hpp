@@ -109,6 +109,22 @@ namespace queries {
     virtual mtc::api<IQuery>  Duplicate( const Bounds& = {} ) = 0;
   };
 
+ /*
+  * IPrunedQuery
+  *
+  * Вычислитель BM25-запросов с динамическим отсечением (MaxScore).
+  *
+  * MaxWeight() возвращает верхнюю оценку веса любого найденного документа, а SetMinWeight()
+  * задаёт текущий порог top-k: документы, чей вес заведомо ниже порога, могут быть
+  * пропущены без чтения координат.
+  */
+  struct IPrunedQuery: IQuery
+  {
+    virtual double  MaxWeight() = 0;
+    virtual double  GetMinWeight() = 0;
+    virtual void    SetMinWeight( double ) = 0;
+  };
+
   auto  GetQuotation( const Abstract& ) -> Abstract::Entries;
 
   auto  MakeAbstract( mtc::Arena&, const std::initializer_list<Abstract::EntrySet>& ) -> Abstract;
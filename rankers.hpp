@@ -1,13 +1,54 @@
 # if !defined( __structo_rankers_hpp__ )
 # define __structo_rankers_hpp__
 # include "queries.hpp"
+# include <vector>
 
 namespace structo {
 namespace rankers {
 
+  struct Ranked
+  {
+    uint32_t  entity;
+    double    weight;
+  };
+
   auto  BM25( const queries::Abstract& ) -> double;
   auto  Rich( const queries::Abstract& ) -> double;
 
+ /*
+  * BM25Bound( idf )
+  *
+  * Upper estimate of the BM25() contribution of a term with the given idf.
+  */
+  auto  BM25Bound( double ) -> double;
+
+ /*
+  * BM25Bound( idf, words )
+  *
+  * BM25() contribution of a term with the given idf occuring once in the entity of
+  * words length; never exceeds BM25Bound( idf ) and decreases with the length.
+  */
+  auto  BM25Bound( double, unsigned ) -> double;
+
+ /*
+  * BM25TopK( query, count )
+  *
+  * Evaluates the query and returns up to count best entities ranked by BM25()
+  * in descending order. Queries implementing IPrunedQuery receive the current
+  * top-k threshold and skip entities that cannot get into the result; the previous
+  * threshold of the query is restored on return.
+  */
+  auto  BM25TopK( const mtc::api<queries::IQuery>&, size_t ) -> std::vector<Ranked>;
+
+ /*
+  * BM25TopK( query, count, threads )
+  *
+  * Parallel variant: splits the entities range to shards with IQuery::Duplicate( bounds ),
+  * evaluates the shards on the persistent thread pool, no more than threads at once
+  * (0 - by hardware), and merges the ranked results.
+  */
+  auto  BM25TopK( const mtc::api<queries::IQuery>&, size_t, unsigned ) -> std::vector<Ranked>;
+
 }}
 
 # endif   // !__structo_rankers_hpp__
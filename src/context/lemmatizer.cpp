@@ -1,6 +1,12 @@
 # include "../../context/lemmatizer.hpp"
 # include <mtc/sharedLibrary.hpp>
+# include <mtc/wcsstr.h>
+# include <unordered_map>
+# include <shared_mutex>
+# include <atomic>
+# include <mutex>
 # include <memory>
+# include <vector>
 
 namespace structo {
 namespace context {
@@ -22,6 +28,171 @@ namespace context {
 
   };
 
+  class LemmaCache final: public ILemmatizer
+  {
+    implement_lifetime_control
+
+    enum: size_t
+    {
+      shard_count = 0x10,
+      max_word_length = 0x40
+    };
+
+    struct Record
+    {
+      uint32_t              uclass;
+      float                 fprobe;
+      mtc::widestr          strStem;      // empty for terms
+      std::vector<uint8_t>  aForms;
+    };
+
+    struct Results
+    {
+      int                 nerror;
+      std::vector<Record> record;
+      std::atomic<bool>   wasHit;
+
+      Results( int n, std::vector<Record>&& r ):
+        nerror( n ),
+        record( std::move( r ) ),
+        wasHit( false ) {}
+    };
+
+    struct Shard
+    {
+      std::unordered_map<mtc::widestr, Results> words;
+      mutable std::shared_mutex                 rwlock;
+    };
+
+    class Recorder;
+
+  public:
+    LemmaCache( const mtc::api<ILemmatizer>& lem, size_t max ):
+      module( lem ),
+      maxLen( std::max( max / shard_count, size_t(1) ) ) {}
+
+  public:
+    int   Lemmatize( IWord*, unsigned, const widechar*, size_t ) override;
+    int   Wildcards( IWord*, unsigned, const widechar*, size_t ) override;
+
+  protected:
+    static  int   Replay( IWord*, const Results& );
+    void  Insert( Shard&, const mtc::widestr&, int, std::vector<Record>&& );
+
+  protected:
+    mtc::api<ILemmatizer> module;
+    const size_t          maxLen;
+    Shard                 shards[shard_count];
+
+  };
+
+ /*
+  * LemmaCache::Recorder
+  *
+  * Passes the lexemes to the output and keeps the copies to be cached.
+  */
+  class LemmaCache::Recorder final: public IWord
+  {
+    implement_lifetime_stub
+
+  public:
+    Recorder( IWord* out ): output( out ) {}
+
+    void  AddTerm( uint32_t lex, float flp, const uint8_t* forms, size_t count ) override
+    {
+      record.push_back( { lex, flp, {}, { forms, forms + count } } );
+      output->AddTerm( lex, flp, forms, count );
+    }
+    void  AddStem( const widechar* pws, size_t len, uint32_t cls, float flp, const uint8_t* forms, size_t count ) override
+    {
+      record.push_back( { cls, flp, { pws, len }, { forms, forms + count } } );
+      output->AddStem( pws, len, cls, flp, forms, count );
+    }
+
+  public:
+    IWord*              output;
+    std::vector<Record> record;
+
+  };
+
+  // LemmaCache implementation
+
+  int   LemmaCache::Lemmatize( IWord* lemmas, unsigned uflags, const widechar* pwsstr, size_t cchstr )
+  {
+    thread_local mtc::widestr getkey;
+
+    if ( cchstr > max_word_length )
+      return module->Lemmatize( lemmas, uflags, pwsstr, cchstr );
+
+  // the key is the flags followed by the word
+    getkey.assign( 1, widechar(uflags) ).append( pwsstr, cchstr );
+
+    auto& rshard = shards[std::hash<mtc::widestr>()( getkey ) % shard_count];
+
+  // check if the word is already cached
+    {
+      auto  shlock = std::shared_lock<std::shared_mutex>( rshard.rwlock );
+      auto  pfound = rshard.words.find( getkey );
+
+      if ( pfound != rshard.words.end() )
+        return pfound->second.wasHit = true, Replay( lemmas, pfound->second );
+    }
+
+  // lemmatize && cache the results
+    {
+      auto  record = Recorder( lemmas );
+      auto  nerror = module->Lemmatize( &record, uflags, pwsstr, cchstr );
+
+      return Insert( rshard, getkey, nerror, std::move( record.record ) ), nerror;
+    }
+  }
+
+  int   LemmaCache::Wildcards( IWord* lemmas, unsigned uflags, const widechar* pwsstr, size_t cchstr )
+  {
+    return module->Wildcards( lemmas, uflags, pwsstr, cchstr );
+  }
+
+  int   LemmaCache::Replay( IWord* lemmas, const Results& cached )
+  {
+    for ( auto& next: cached.record )
+    {
+      if ( next.strStem.empty() )
+      {
+        lemmas->AddTerm( next.uclass, next.fprobe,
+          next.aForms.data(), next.aForms.size() );
+      }
+        else
+      {
+        lemmas->AddStem( next.strStem.data(), next.strStem.size(), next.uclass, next.fprobe,
+          next.aForms.data(), next.aForms.size() );
+      }
+    }
+    return cached.nerror;
+  }
+
+ /*
+  * The shard overflow gives the second chance to the words found since the previous
+  * overflow and drops the others, so the frequent words stay in the cache.
+  */
+  void  LemmaCache::Insert( Shard& shard, const mtc::widestr& key, int nerror, std::vector<Record>&& record )
+  {
+    auto  exlock = std::unique_lock<std::shared_mutex>( shard.rwlock );
+
+    if ( shard.words.size() >= maxLen )
+    {
+      for ( auto it = shard.words.begin(); it != shard.words.end(); )
+        if ( !it->second.wasHit.exchange( false ) ) it = shard.words.erase( it );
+          else ++it;
+
+      if ( shard.words.size() >= maxLen )
+        shard.words.clear();
+    }
+
+    shard.words.emplace( std::piecewise_construct,
+      std::forward_as_tuple( key ),
+      std::forward_as_tuple( nerror, std::move( record ) ) );
+  }
+
   // DynaModule implementation
 
   DynaModule::DynaModule( mtc::SharedLibrary libmod, const char* args )
@@ -59,4 +230,12 @@ namespace context {
     return LoadLemmatizer( path.c_str(), args.c_str() );
   }
 
+  auto  CacheLemmatizer( const mtc::api<ILemmatizer>& module, size_t maxWords ) -> mtc::api<ILemmatizer>
+  {
+    if ( module == nullptr || maxWords == 0 || dynamic_cast<const LemmaCache*>( module.ptr() ) != nullptr )
+      return module;
+
+    return new LemmaCache( module, maxWords );
+  }
+
 }}
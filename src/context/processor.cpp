@@ -1,4 +1,9 @@
 # include "../../context/processor.hpp"
+# include "../../context/lemmatizer.hpp"
+# include <exception>
+# include <atomic>
+# include <thread>
+# include <mutex>
 
 namespace structo {
 namespace context {
@@ -19,6 +24,51 @@ namespace context {
     return std::move( MakeImage( image, input, fdset ) );
   }
 
+  void  Processor::MakeImages( size_t count,
+    const std::function<const ITextView&( size_t )>&  input,
+    const std::function<void( size_t, const Image& )>& output,
+    const FieldHandler* fdset, unsigned nThreads ) const
+  {
+    auto  nextId = std::atomic<size_t>( 0 );
+    auto  except = std::exception_ptr();
+    auto  exlock = std::mutex();
+    auto  worker = std::vector<std::thread>();
+    auto  doWork = [&]()
+      {
+        auto  image = Image();
+
+        for ( auto idoc = nextId++; idoc < count; idoc = nextId++ )
+        {
+          try
+            {  output( idoc, MakeImage( image, input( idoc ), fdset ) );  }
+          catch ( ... )
+            {
+              auto  locker = std::unique_lock<std::mutex>( exlock );
+
+              if ( except == nullptr )
+                except = std::current_exception();
+              nextId = count;
+            }
+        }
+      };
+
+    if ( nThreads == 0 )
+      nThreads = std::max( 1U, std::thread::hardware_concurrency() );
+
+  // the only thread is the caller one
+    if ( nThreads == 1 || count <= 1 )
+      doWork();
+    else
+    for ( unsigned i = 0; i != std::min( size_t(nThreads), count ); ++i )
+      worker.emplace_back( doWork );
+
+    for ( auto& next: worker )
+      next.join();
+
+    if ( except != nullptr )
+      std::rethrow_exception( except );
+  }
+
   auto  Processor::Lemmatize( const mtc::widestr& str ) const -> std::vector<Lexeme>
   {
     std::vector<Lexeme> lexbuf;
@@ -39,14 +89,14 @@ namespace context {
 
   auto  Processor::AddModule( unsigned langId, const mtc::api<ILemmatizer>& module ) -> Processor&
   {
-    languages.push_back( { langId, module } );
+    languages.push_back( { langId, CacheLemmatizer( module ) } );
     return *this;
   }
 
   auto  Processor::Initialize( const mtc::span<const std::pair<unsigned, const mtc::api<ILemmatizer>>>& init ) ->Processor&
   {
     for ( auto& next: init )
-      languages.push_back( { next.first, next.second } );
+      languages.push_back( { next.first, CacheLemmatizer( next.second ) } );
     return *this;
   }
 
@@ -2,7 +2,9 @@
 # include "../../context/pack-format.hpp"
 # include "../../compat.hpp"
 # include <mtc/arbitrarymap.h>
-# include <mtc/arena.hpp>
+# include <memory>
+# include <atomic>
+# include <vector>
 
 namespace structo {
 namespace context {
@@ -45,8 +47,76 @@ namespace context {
     char                        docSizeBuf[0x20];
   };
 
+ /*
+  * ScratchArena - арена, сохраняющая выделенные блоки памяти после Reset().
+  *
+  * Память не освобождается по отдельности; Reset() возвращает все блоки для
+  * следующего документа, оставляя не более keep_limit байт.
+  */
+  class ScratchArena
+  {
+    enum: size_t
+    {
+      chunk_size = 0x10000,
+      keep_limit = 0x1000000
+    };
+
+    struct Chunk
+    {
+      std::unique_ptr<char[]> data;
+      size_t                  size;
+    };
+
+  public:
+    template <class T>
+    class allocator;
+
+  public:
+    auto  allocate( size_t, size_t ) -> void*;
+    void  Reset();
+
+    template <class T, class... Args>
+    auto  Create( Args&&... ) -> T*;
+
+  protected:
+    std::vector<Chunk>  chunks;
+    size_t              ichunk = 0;
+    size_t              offset = 0;
+
+  };
+
+  template <class T>
+  class ScratchArena::allocator
+  {
+    template <class U>
+    friend class allocator;
+
+  public:
+    using value_type = T;
+
+    allocator( ScratchArena* owner ): arena( owner ) {}
+    template <class U>
+    allocator( const allocator<U>& other ): arena( other.arena ) {}
+
+    auto  allocate( size_t n ) -> T*
+      {  return (T*)arena->allocate( n * sizeof(T), alignof(T) );  }
+    void  deallocate( T*, size_t ) {}
+
+    template <class U>
+    bool  operator == ( const allocator<U>& other ) const {  return arena == other.arena;  }
+    template <class U>
+    bool  operator != ( const allocator<U>& other ) const {  return arena != other.arena;  }
+
+  protected:
+    ScratchArena* arena;
+
+  };
+
  /*
   * RichImpl - предельно подробная детализация вхождений, и форматирование вдогонку.
+  *
+  * Построитель переиспользуется потоком для следующих документов, если созданное им
+  * содержимое уже освобождено: арена и буферы сохраняют выделенную память.
   */
   class RichImpl: public Contents::impl
   {
@@ -63,16 +133,19 @@ namespace context {
     struct RichEntry;
     class  Positions;
     class  WordForms;
-    using  KeyMapper = mtc::arbitrarymap<size_t, mtc::Arena::allocator<char>>;
+    using  KeyMapper = mtc::arbitrarymap<size_t, ScratchArena::allocator<char>>;
 
   public:
     RichImpl(): keyMapping( allocArena.Create<KeyMapper>() )  {}
+   ~RichImpl()  {  keyMapping->~KeyMapper();  }
 
     void  AddEntry( const Lexeme&, unsigned pos );
+    void  Reset();
 
   protected:
-    mtc::Arena  allocArena;
-    KeyMapper*  keyMapping;
+    ScratchArena      allocArena;
+    KeyMapper*        keyMapping;
+    std::atomic<bool> inUse { false };
 
   };
 
@@ -102,12 +175,12 @@ namespace context {
       size_t  GetSpace() const {  return std::end( buff ) - pend;  }
     };
 
-    using allocator_type = rebind<mtc::Arena::allocator<char>, EntryBlock>;
+    using allocator_type = rebind<ScratchArena::allocator<char>, EntryBlock>;
 
     auto  Finish() -> std::string_view override;
 
   public:
-    Positions( const mtc::Arena::allocator<char>& alloc ): allocEntries( alloc ) {}
+    Positions( const ScratchArena::allocator<char>& alloc ): allocEntries( alloc ) {}
 
     void  AddRecord( unsigned entry );
 
@@ -150,12 +223,12 @@ namespace context {
       FormsEntry* pend = buff;
     };
 
-    using allocator_type = rebind<mtc::Arena::allocator<char>, EntryBlock>;
+    using allocator_type = rebind<ScratchArena::allocator<char>, EntryBlock>;
 
     auto  Finish() -> std::string_view override;
 
   public:
-    WordForms( const mtc::Arena::allocator<char>& alloc ): allocEntries( alloc ) {}
+    WordForms( const ScratchArena::allocator<char>& alloc ): allocEntries( alloc ) {}
 
     void  AddRecord( unsigned pos, uint8_t fid );
 
@@ -170,6 +243,48 @@ namespace context {
 
   static const char dsrKey[3] = { 'd', 's', 'r' };
 
+  // ScratchArena implementation
+
+  auto  ScratchArena::allocate( size_t size, size_t align ) -> void*
+  {
+    auto  aligned = []( const Chunk& chunk, size_t offset, size_t align )
+      {  return offset + (align - uintptr_t(chunk.data.get() + offset) % align) % align;  };
+
+  // find the next kept chunk large enough or allocate the new one
+    while ( ichunk < chunks.size() && aligned( chunks[ichunk], offset, align ) + size > chunks[ichunk].size )
+      ++ichunk, offset = 0;
+
+    if ( ichunk == chunks.size() )
+    {
+      auto  length = std::max( size_t(chunk_size), size + align );
+
+      chunks.push_back( { std::unique_ptr<char[]>( new char[length] ), length } );
+    }
+
+    offset = aligned( chunks[ichunk], offset, align ) + size;
+
+    return chunks[ichunk].data.get() + offset - size;
+  }
+
+  void  ScratchArena::Reset()
+  {
+    auto  nalloc = size_t(0);
+    auto  nchunk = size_t(0);
+
+  // keep the first chunks up to the limit
+    while ( nchunk != chunks.size() && (nchunk == 0 || nalloc + chunks[nchunk].size <= keep_limit) )
+      nalloc += chunks[nchunk++].size;
+
+    chunks.resize( nchunk );
+    ichunk = offset = 0;
+  }
+
+  template <class T, class... Args>
+  auto  ScratchArena::Create( Args&&... args ) -> T*
+  {
+    return new( allocate( sizeof(T), alignof(T) ) ) T( std::forward<Args>( args )..., allocator<char>( this ) );
+  }
+
   // Contents implementation
 
   auto  Contents::get() const -> mtc::span<const EntryView>
@@ -269,17 +384,27 @@ namespace context {
     const mtc::span<const mtc::span<const Lexeme>>& lemm,
     const mtc::span<const DeliriX::MarkupTag>&      mkup, FieldHandler& fman ) -> Contents
   {
+    thread_local std::shared_ptr<RichImpl> threadRich;
+
     auto    contents = Contents();
-    auto    implRich = new RichImpl();
     auto    tag_pack = formats::Pack( mkup, fman );
     auto    def_opts = fman.Get( "default_field" );
     auto    no_index = std::vector<uint64_t>();
     auto    iterator = RichImpl::KeyMapper::iterator();
     size_t  ccBuffer;
 
-  // create contents object
-    contents.contents = std::shared_ptr<Contents::impl>( implRich,
-      []( Contents::impl* p ){  delete (RichImpl*)p;  } );
+  // reuse the thread builder if the previous contents is released
+    if ( threadRich != nullptr && !threadRich->inUse.load( std::memory_order_acquire ) )
+      threadRich->Reset();
+    else
+      threadRich = std::make_shared<RichImpl>();
+
+    auto    implRich = threadRich.get();
+
+    implRich->inUse = true;
+
+    contents.contents = std::shared_ptr<Contents::impl>( implRich, [holder = threadRich]( Contents::impl* p )
+      {  ((RichImpl*)p)->inUse.store( false, std::memory_order_release );  } );
 
   // set no_index flags
     if ( def_opts != nullptr && (def_opts->options & FieldOptions::ofDisableIndex) != 0 )
@@ -326,6 +451,15 @@ namespace context {
     return contents;
   }
 
+  void  RichImpl::Reset()
+  {
+    keyMapping->~KeyMapper();
+      allocArena.Reset();
+    keyMapping = allocArena.Create<KeyMapper>();
+
+    entryViews.clear();
+  }
+
   void  RichImpl::AddEntry( const Lexeme& lex, unsigned pos )
   {
     auto  pfound = keyMapping->find( lex );
@@ -1,8 +1,20 @@
 # include "contents-index-merger.hpp"
 # include "dynamic-entities.hpp"
+# include "override-entities.hpp"
+# include "doc-dowels.hpp"
 # include "../../compat.hpp"
 # include <mtc/radix-tree.hpp>
+# include <condition_variable>
 # include <stdexcept>
+# include <algorithm>
+# include <memory>
+# include <thread>
+# include <deque>
+# include <mutex>
+
+template <> inline
+std::vector<char>* Serialize( std::vector<char>* o, const void* p, size_t l )
+  {  return o != nullptr ? o->insert( o->end(), (const char*)p, l + (const char*)p ), o : nullptr;  }
 
 namespace structo {
 namespace indexer {
@@ -12,8 +24,10 @@ namespace fusion {
   using IRecordIterator = IContentsIndex::IContentsList;
   using EntityReference = IContentsIndex::IEntities::Reference;
 
-  constexpr size_t    max_docids = 0x200;
-  constexpr uint32_t  max_length = 1 * 0x400 * 0x400;
+  constexpr unsigned  max_workers = 4;              // merge threads limit
+  constexpr size_t    batch_refs = 0x40000;         // references per merge batch
+  constexpr size_t    large_key = 0x40000;          // references count to be merged in place
+  constexpr size_t    flight_refs = 0x200000;       // references in all the batches in work
 
   class EntityIterator
   {
@@ -30,6 +44,8 @@ namespace fusion {
   public:
     auto  operator -> () const -> mtc::api<const IEntity>
       {  return curValue;  }
+    auto  Value() const -> const mtc::api<const IEntity>&
+      {  return curValue;  }
     auto  Curr() -> const EntityId&
       {  return entityId;  }
     auto  Next() -> const EntityId&
@@ -91,16 +107,6 @@ namespace fusion {
 
   };
 
- /*
-  * DocAnchor отправляет в точку, где надо вычитывать приращение документа с индексом
-  * больше указанного, на нужное смещение.
-  */
-  struct DocAnchor
-  {
-    unsigned  lastId;
-    uint64_t  offset;
-  };
-
   struct BlockInfo
   {
     uint32_t  ucount;
@@ -120,23 +126,26 @@ namespace fusion {
     return ::Serialize( buffer, diffi );
   }
 
-  template <char* (*SerializeEntity)(char*, uint32_t, uint32_t)>
+  template <char* (*SerializeEntity)(char*, uint32_t, uint32_t), class O>
   auto  MergeChains(
-    mtc::api<mtc::IByteStream>      output,
+    O*                              output,
     std::vector<EntityReference>&   buffer,
     const std::vector<MapEntities>& blocks ) -> BlockInfo
   {
-    auto      points = std::vector<DocAnchor>();
+    auto      lessId = []( const EntityReference& a, const EntityReference& b )
+      {  return a.uEntity < b.uEntity;  };
+    auto      points = DocDowels();
     uint64_t  length = 0;
     uint32_t  uOldId = 0;
-    DocAnchor daPrev = { 0, 0 };
-    auto      nitems = size_t(0);     // objects in section
-    auto      cbPart = uint32_t(0);   // current sec length
     char      docbuf[0x40];
     size_t    doclen;
 
+  // each block produces a run of references; the run is sorted only if the remapping
+  // has broken the order, then it is merged with previous runs
     for ( auto& block: blocks )
     {
+      auto      runTop = buffer.size();
+      auto      sorted = true;
       uint32_t  mapped;
 
       // list all the references in the block
@@ -146,14 +155,17 @@ namespace fusion {
         {
           if ( buffer.size() == buffer.capacity() )
             buffer.reserve( buffer.capacity() + 0x10000 );
+          sorted &= buffer.size() == runTop || buffer.back().uEntity < mapped;
           buffer.push_back( { mapped, entry.details } );
         }
       }
-    }
 
-    // check if any objects in a buffer, resort, serialize and return the length
-    std::sort( buffer.begin(), buffer.end(), []( const EntityReference& a, const EntityReference& b )
-      {  return a.uEntity < b.uEntity; } );
+      if ( !sorted )
+        std::sort( buffer.begin() + runTop, buffer.end(), lessId );
+
+      if ( runTop != 0 )
+        std::inplace_merge( buffer.begin(), buffer.begin() + runTop, buffer.end(), lessId );
+    }
 
     for ( auto& reference: buffer )
     {
@@ -162,39 +174,85 @@ namespace fusion {
 
     // serialize next difference
       doclen = SerializeEntity( docbuf, diffId, nbytes ) - docbuf;
-        ::Serialize( ::Serialize( output.ptr(), docbuf, doclen ), reference.details.data(), nbytes );
+        ::Serialize( ::Serialize( output, docbuf, doclen ), reference.details.data(), nbytes );
 
       length += nbytes + doclen;
-      cbPart += nbytes + doclen;
-
-      uOldId = reference.uEntity;
 
-      // check for navigation point needed:
-      // * too many documents
-      // * too long block
-      if ( (++nitems % max_docids) == 0 || cbPart >= max_length )
-      {
-        points.push_back( { uOldId, length } );
-        nitems = 1;
-        cbPart = 0;
-      }
+    // check for navigation point needed
+      points.Add( uOldId = reference.uEntity, length, uint32_t(nbytes + doclen) );
     }
 
   // write navigation block
-    cbPart = 0;
+    points.Serialize( output );
 
-    for ( auto& next: points )
+    return { uint32_t(buffer.size()), length, points.GetBufLen() };
+  }
+
+  struct KeyRecord
+  {
+    std::string         keyStr;
+    std::vector<size_t> source;             // indices of source indices
+    RadixLink           rdLink = { 0, 0, 0, 0, 0 };
+  };
+
+ /*
+  * MergeBatch - последовательность ключей, сливаемых одним потоком в собственный буфер.
+  *
+  * Буферы выводятся в порядке ключей, и смещения блоков в rdLink корректируются при выводе.
+  * Размер пакета ограничен суммарным числом ссылок ключей, а не числом ключей, чтобы
+  * буферы пакетов в работе занимали ограниченный объём памяти.
+  */
+  struct MergeBatch
+  {
+    enum: int
     {
-      doclen = ::Serialize( ::Serialize( docbuf,
-        next.lastId - daPrev.lastId ),
-        next.offset - daPrev.offset ) - docbuf;
+      queued = 0,
+      merging = 1,
+      merged = 2
+    };
+
+    std::vector<KeyRecord>  keyList;
+    std::vector<char>       outData;
+    size_t                  nRefer = 0;       // references of the keys
+    int                     nStatus = queued;
+  };
 
-      ::Serialize( output.ptr(), docbuf, doclen );
-        cbPart += doclen;
-        daPrev = next;
-    }
+  template <class O>
+  auto  MergeKey(
+    O*                                            output,
+    std::vector<EntityReference>&                 buffer,
+    const KeyRecord&                              record,
+    const std::vector<mtc::api<IContentsIndex>>&  indices,
+    const std::vector<std::vector<uint32_t>>&     remapId ) -> RadixLink
+  {
+    auto  blockList = std::vector<MapEntities>( record.source.size() );
+    auto  mergeStat = BlockInfo{};
+
+    for ( size_t i = 0; i != record.source.size(); ++i )
+      blockList[i] = { indices[record.source[i]]->GetKeyBlock( record.keyStr ), &remapId[record.source[i]] };
 
-    return { uint32_t(buffer.size()), length, cbPart };
+    buffer.resize( 0 );
+
+    mergeStat = blockList.front().entityBlock->Type() == 0 ?
+      MergeChains<SerializeZeroData>( output, buffer, blockList ) :
+      MergeChains<SerializeWithData>( output, buffer, blockList );
+
+    return { blockList.front().entityBlock->Type(), mergeStat.ucount, 0, mergeStat.blkLen, mergeStat.navLen };
+  }
+
+  void  MergeKeys(
+    MergeBatch&                                   merged,
+    std::vector<EntityReference>&                 buffer,
+    const std::vector<mtc::api<IContentsIndex>>&  indices,
+    const std::vector<std::vector<uint32_t>>&     remapId )
+  {
+    for ( auto& next: merged.keyList )
+    {
+      auto  offset = merged.outData.size();
+
+      next.rdLink = MergeKey( &merged.outData, buffer, next, indices, remapId );
+      next.rdLink.offset = offset;
+    }
   }
 
   void  ContentsMerger::MergeEntities()
@@ -206,15 +264,19 @@ namespace fusion {
     auto  entityStm = storage->Entities();
     auto  bundleStm = storage->Packages();
     auto  entity_id = uint32_t(1);
+    auto  entImages = EntitiesImage::Builder();
+    auto  zeroEntry = Entity( std::allocator<char>() );
 
   // create iterators list
     for ( auto& next: indices )
       iterators.emplace_back( next );
 
   // set zero document
-    if ( Entity( std::allocator<char>() ).Serialize( entityStm.ptr() ) == nullptr )
+    if ( zeroEntry.Serialize( entityStm.ptr() ) == nullptr )
       throw std::runtime_error( "Failed to serialize entities" );
 
+    entImages.Add( zeroEntry.GetBufLen(), {}, 0 );
+
     for ( ; ; )
     {
       auto  nCount = size_t(0);
@@ -246,10 +308,21 @@ namespace fusion {
         auto  bundlePos = int64_t(-1);
         auto  bundlePtr = mtc::api<const mtc::IByteBuffer>();
 
-        if ( bundleStm != nullptr && (bundlePtr = iterators[iFresh]->GetBundle()) != nullptr )
-          bundlePos = bundleStm->Put( bundlePtr->GetPtr(), bundlePtr->GetLen() );
+      // copy or share the stored bundle record if the entity refers one, else put the bundle
+        if ( bundleStm != nullptr )
+        {
+          auto  bundleRef = Override::Entity( iterators[iFresh].Value() ).GetBundleRef();
+
+          if ( bundleRef.first != nullptr )
+            bundlePos = bundleStm->Copy( *bundleRef.first.ptr(), bundleRef.second );
+          else
+          if ( (bundlePtr = iterators[iFresh]->GetBundle()) != nullptr )
+            bundlePos = bundleStm->Put( bundlePtr->GetPtr(), bundlePtr->GetLen() );
+        }
+
+        auto  newEntity = Entity( std::allocator<char>() );
 
-        if ( Entity( std::allocator<char>() )
+        if ( newEntity
           .SetId( iterators[iFresh].Curr() )
           .SetIndex( entity_id )
           .SetExtra( make_view( iterators[iFresh]->GetExtra() ) )
@@ -259,6 +332,8 @@ namespace fusion {
           throw std::runtime_error( "Failed to serialize entities" );
         }
 
+        entImages.Add( newEntity.GetBufLen(), newEntity.GetId(), entity_id );
+
       // fill renumbering maps and request next documents
         for ( size_t i = 0; i != nCount; ++i )
         {
@@ -271,6 +346,11 @@ namespace fusion {
         }
       } else break;
     }
+
+  // finish with the navigation tail for the static entities table
+    if ( entImages.Serialize( entityStm.ptr() ) == nullptr )
+      throw std::runtime_error( "Failed to serialize entities" );
+
     statMap["obj-count"] = uint32_t(entity_id);
   }
 
@@ -282,68 +362,226 @@ namespace fusion {
     auto  selectSet = std::vector<size_t>( indices.size() );
     auto  refVector = std::vector<EntityReference>( 0x100000 );
     auto  radixTree = mtc::radix::tree<RadixLink>();
-    auto  keyRecord = RadixLink{ 0, 0, 0, 0, 0 };
+    auto  keyRecord = KeyRecord();
+    auto  nWorkers  = nThreads != 0 ? nThreads : std::min( max_workers, std::thread::hardware_concurrency() );
+    auto  keyBatch  = std::unique_ptr<MergeBatch>();
+    auto  chainsLen = uint64_t(0);
+    auto  inFlight  = size_t(0);              // references of the batches in work
+
+    std::mutex                              mxLock;
+    std::condition_variable                 cvWait;
+    std::deque<std::unique_ptr<MergeBatch>> batches;
+    std::vector<std::thread>                workers;
+    std::exception_ptr                      failure;
+    bool                                    isFinal = false;
+
+  // batch merging thread: finds the first queued batch and merges it to own buffer
+    auto  mergeFunc = [&]()
+    {
+      auto  buffer = std::vector<EntityReference>();
+      auto  exlock = std::unique_lock<std::mutex>( mxLock );
 
-  // create iterators list
-    for ( auto& next : indices )
-      iterators.emplace_back( next );
+      for ( ; ; )
+      {
+        auto  pfound = std::find_if( batches.begin(), batches.end(), []( const std::unique_ptr<MergeBatch>& batch )
+          {  return batch->nStatus == MergeBatch::queued;  } );
+        auto  pbatch = (MergeBatch*)nullptr;
 
-  // list all the keys and select merge lists
-    for ( ; ; )
+        if ( pfound == batches.end() )
+        {
+          if ( isFinal )
+            break;
+          cvWait.wait( exlock );
+          continue;
+        }
+
+        (pbatch = pfound->get())->nStatus = MergeBatch::merging;
+          exlock.unlock();
+
+        try
+          {  MergeKeys( *pbatch, buffer, indices, remapId );  }
+        catch ( ... )
+          {  exlock.lock();  failure = std::current_exception();  exlock.unlock();  }
+
+        exlock.lock();
+          pbatch->nStatus = MergeBatch::merged;
+        cvWait.notify_all();
+      }
+    };
+
+  // stop and join the merging threads on any exit
+    auto  stopFunc = [&]()
     {
-      auto  nCount = size_t(0);
-      auto  select = (const std::string*)nullptr;
+      mxLock.lock();
+        isFinal = true;
+      mxLock.unlock();
 
-    // select lower key
-      for ( size_t i = 0; i != iterators.size(); ++i )
-        if ( !iterators[i].Curr().empty() )
+      cvWait.notify_all();
+
+      for ( auto& next: workers )
+        if ( next.joinable() )
+          next.join();
+    };
+
+  // output the key record at current linkages offset
+    auto  insertKey = [&]( KeyRecord& record )
+    {
+      if ( record.rdLink.blkLen != 0 )
+      {
+        record.rdLink.offset += chainsLen;
+        radixTree.Insert( record.keyStr, record.rdLink );
+      }
+    };
+
+  // write merged batches in the order of keys until there are no more than maxFlight
+  // references in the batches in work
+    auto  flushOut = [&]( size_t maxFlight )
+    {
+      auto  exlock = std::unique_lock<std::mutex>( mxLock );
+
+      for ( ; ; )
+      {
+        if ( failure != nullptr )
+          std::rethrow_exception( failure );
+
+        if ( !batches.empty() && batches.front()->nStatus == MergeBatch::merged )
         {
-          int   rescmp;
+          auto  merged = std::move( batches.front() );
+
+          batches.pop_front();
+          inFlight -= merged->nRefer;
+            exlock.unlock();
 
-          if ( nCount == 0 || (rescmp = select->compare( iterators[i].Curr() )) >= 0 )
+          for ( size_t cbdone = 0, cbpart; cbdone < merged->outData.size(); cbdone += cbpart )
           {
-            if ( rescmp > 0 )
-              nCount = 0;
-            select = &iterators[selectSet[nCount++] = i].Curr();
+            cbpart = std::min( merged->outData.size() - cbdone, size_t(0x40000000) );
+
+            if ( ::Serialize( chains.ptr(), merged->outData.data() + cbdone, cbpart ) == nullptr )
+              throw std::runtime_error( "Failed to serialize linkages @" __FILE__ ":" LINE_STRING );
           }
+
+          for ( auto& next: merged->keyList )
+            insertKey( next );
+
+          chainsLen += merged->outData.size();
+            exlock.lock();
+          continue;
         }
 
-    // check if key is available
-      if ( nCount != 0 )
+        if ( inFlight <= maxFlight )
+          break;
+
+        cvWait.wait( exlock );
+      }
+    };
+
+  // queue the filled batch to the merging threads
+    auto  queueKeys = [&]()
+    {
+      if ( keyBatch != nullptr && !keyBatch->keyList.empty() )
       {
-        auto  blockList = std::vector<MapEntities>( nCount );
-        auto  mergeStat = BlockInfo{};
+        flushOut( flight_refs - keyBatch->nRefer );
 
-        for ( size_t i = 0; i != nCount; ++i )
-          blockList[i] = { indices[selectSet[i]]->GetKeyBlock( *select ), &remapId[selectSet[i]] };
+        mxLock.lock();
+          inFlight += keyBatch->nRefer;
+          batches.emplace_back( std::move( keyBatch ) );
+        mxLock.unlock();
+
+        cvWait.notify_all();
+      }
+      keyBatch = nullptr;
+    };
+
+  // create iterators list
+    for ( auto& next : indices )
+      iterators.emplace_back( next );
+
+    try
+    {
+      for ( auto n = nWorkers > 1 ? nWorkers : 0; n != 0; --n )
+        workers.emplace_back( mergeFunc );
+
+    // list all the keys and select merge lists
+      for ( ; ; )
+      {
+        auto  nCount = size_t(0);
+        auto  select = (const std::string*)nullptr;
+
+      // select lower key
+        for ( size_t i = 0; i != iterators.size(); ++i )
+          if ( !iterators[i].Curr().empty() )
+          {
+            int   rescmp;
+
+            if ( nCount == 0 || (rescmp = select->compare( iterators[i].Curr() )) >= 0 )
+            {
+              if ( rescmp > 0 )
+                nCount = 0;
+              select = &iterators[selectSet[nCount++] = i].Curr();
+            }
+          }
 
-        refVector.resize( 0 );
+      // check if key is available
+        if ( nCount == 0 )
+          break;
 
-        mergeStat = blockList.front().entityBlock->Type() == 0 ?
-          MergeChains<SerializeZeroData>( chains, refVector, blockList ) :
-          MergeChains<SerializeWithData>( chains, refVector, blockList );
+        auto  queued = false;
 
-        if ( mergeStat.blkLen != 0 )
+        keyRecord.keyStr = *select;
+        keyRecord.source.assign( selectSet.begin(), selectSet.begin() + nCount );
+
+      // small keys are collected to batches merged by the merging threads, and large
+      // ones are merged right to the output not to hold the data in memory
+        if ( !workers.empty() )
         {
-          keyRecord.bkType = blockList.front().entityBlock->Type();
-          keyRecord.uCount = mergeStat.ucount;
-          keyRecord.blkLen = mergeStat.blkLen;
-          keyRecord.navLen = mergeStat.navLen;
+          auto  nrefer = size_t(0);
+
+          for ( auto src: keyRecord.source )
+            nrefer += indices[src]->GetKeyStats( keyRecord.keyStr ).nCount;
+
+          if ( (queued = nrefer < large_key) == true )
+          {
+            if ( keyBatch == nullptr )
+              keyBatch = std::make_unique<MergeBatch>();
+
+            keyBatch->keyList.push_back( keyRecord );
 
-          radixTree.Insert( *select, keyRecord );
+            if ( (keyBatch->nRefer += nrefer) >= batch_refs )
+              queueKeys();
+          }
+            else
+          {
+            queueKeys();
+            flushOut( 0 );
+          }
+        }
 
-          keyRecord.offset += mergeStat.blkLen + mergeStat.navLen;
+      // merge the key in place if not queued
+        if ( !queued )
+        {
+          keyRecord.rdLink = MergeKey( chains.ptr(), refVector, keyRecord, indices, remapId );
+          insertKey( keyRecord );
+          chainsLen += keyRecord.rdLink.blkLen + keyRecord.rdLink.navLen;
         }
 
         for ( size_t i = 0; i != nCount; ++i )
           iterators[selectSet[i]].Next();
-      } else break;
+      }
+
+      queueKeys();
+      flushOut( 0 );
+      stopFunc();
+    }
+    catch ( ... )
+    {
+      stopFunc();
+      throw;
     }
 
     radixTree.Serialize( contents.ptr() );
 
     statMap["key-count"] = uint32_t(radixTree.size());
-    statMap["link-size"] = keyRecord.offset;
+    statMap["link-size"] = chainsLen;
   }
 
   auto  ContentsMerger::Add( mtc::api<IContentsIndex> index ) -> ContentsMerger&
@@ -353,6 +591,12 @@ namespace fusion {
     return *this;
   }
 
+  auto  ContentsMerger::Set( unsigned threads ) -> ContentsMerger&
+  {
+    nThreads = threads;
+    return *this;
+  }
+
   auto  ContentsMerger::Set( std::function<bool()> can ) -> ContentsMerger&
   {
     canContinue = can != nullptr ? can : [](){  return true;  };
@@ -15,6 +15,7 @@ namespace fusion {
     ContentsMerger() = default;
 
     auto  Add( mtc::api<IContentsIndex> ) -> ContentsMerger&;
+    auto  Set( unsigned nThreads ) -> ContentsMerger&;
     auto  Set( std::function<bool()> ) -> ContentsMerger&;
     auto  Set( mtc::api<IStorage::IIndexStore> ) -> ContentsMerger&;
     auto  Set( const mtc::api<IContentsIndex>*, size_t ) -> ContentsMerger&;
@@ -28,6 +29,7 @@ namespace fusion {
     void  MergeContents();
 
   protected:
+    unsigned                              nThreads = 0;   // 0 - by hardware
     mtc::api<IStorage::IIndexStore>       storage;
     std::vector<mtc::api<IContentsIndex>> indices;
     std::vector<std::vector<uint32_t>>    remapId;
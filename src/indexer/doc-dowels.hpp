@@ -0,0 +1,91 @@
+# if !defined( __structo_src_indexer_doc_dowels_hpp__ )
+# define __structo_src_indexer_doc_dowels_hpp__
+# include <mtc/serialize.h>
+# include <cstdint>
+# include <vector>
+
+namespace structo {
+namespace indexer {
+
+ /*
+  * DocDowels
+  *
+  * Навигационные точки сериализованного блока вхождений ключа: после каждых
+  * max_docids сущностей или max_length байт запоминается пара (последний индекс
+  * сущности, смещение следующей записи). Точки записываются вслед за блоком
+  * приращениями к предыдущей точке; длина навигации хранится в ссылке на блок.
+  *
+  * Одна и та же разметка создаётся при сохранении динамического индекса и при
+  * слиянии индексов, так что свежий слой не уступает слитому в скорости поиска.
+  */
+  class DocDowels
+  {
+    struct DocDowel
+    {
+      uint32_t  lastId;
+      uint64_t  offset;
+    };
+
+  public:
+    enum: uint32_t
+    {
+      max_docids = 0x200,
+      max_length = 1 * 0x400 * 0x400
+    };
+
+   /*
+    * Add( entity, offset, cbentry )
+    *
+    * Registers the serialized entity record of cbentry bytes ending at offset.
+    */
+    void  Add( uint32_t entity, uint64_t offset, uint32_t cbentry )
+    {
+      cbPart += cbentry;
+
+      if ( (++nItems % max_docids) == 0 || cbPart >= max_length )
+      {
+        points.push_back( { entity, offset } );
+        nItems = 1;
+        cbPart = 0;
+      }
+    }
+
+    auto  GetBufLen() const -> uint32_t
+    {
+      auto  length = uint32_t(0);
+      auto  dwPrev = DocDowel{ 0, 0 };
+
+      for ( auto& next: points )
+      {
+        length += ::GetBufLen( next.lastId - dwPrev.lastId ) + ::GetBufLen( next.offset - dwPrev.offset );
+        dwPrev = next;
+      }
+      return length;
+    }
+
+    template <class O>
+    O*    Serialize( O* o ) const
+    {
+      auto  dwPrev = DocDowel{ 0, 0 };
+      char  navbuf[0x20];
+
+      for ( auto& next: points )
+      {
+        o = ::Serialize( o, navbuf, ::Serialize( ::Serialize( navbuf,
+          next.lastId - dwPrev.lastId ),
+          next.offset - dwPrev.offset ) - navbuf );
+        dwPrev = next;
+      }
+      return o;
+    }
+
+  protected:
+    std::vector<DocDowel> points;
+    size_t                nItems = 0;     // entities in the current section
+    uint32_t              cbPart = 0;     // current section length
+
+  };
+
+}}
+
+# endif   // !__structo_src_indexer_doc_dowels_hpp__
@@ -4,10 +4,15 @@
 # include "../../compat.hpp"
 # include "dynamic-chains-ringbuffer.hpp"
 # include "dynamic-bitmap.hpp"
+# include "doc-dowels.hpp"
 # include "strmatch.hpp"
 # include <mtc/recursive_shared_mutex.hpp>
 # include <mtc/radix-tree.hpp>
 # include <condition_variable>
+# include <shared_mutex>
+# include <algorithm>
+# include <vector>
+# include <mutex>
 # include <thread>
 # include <atomic>
 
@@ -17,7 +22,8 @@ namespace dynamic {
 
   enum: size_t
   {
-    ring_buffer_size = 0x1000
+    ring_buffer_size = 0x1000,
+    merge_keys_tries = 0x10           // failed try_lock()s before the blocking merge
   };
 
   template <class Allocator = std::allocator<char>>
@@ -25,16 +31,49 @@ namespace dynamic {
   {
     struct ChainLink;
     struct ChainHook;
+    struct HashNode;
+    struct HashBucket;
+    struct HashShard;
 
     using AtomicLink = std::atomic<ChainLink*>;
-    using AtomicHook = std::atomic<ChainHook*>;
+    using AtomicNode = std::atomic<HashNode*>;
 
     using LinkAllocator = AllocatorCast<Allocator, ChainLink>;
-    using HookAllocator = AllocatorCast<Allocator, AtomicHook>;
+    using HashAllocator = AllocatorCast<Allocator, HashBucket>;
 
     enum: size_t
     {
-      hash_table_size = 65521
+      shard_count = 0x40,         // independent hash tables selected by the hash value
+      shard_length = 0x400,       // initial buckets count of one shard, the power of 2
+      shard_filling = 2,          // average collisions chain length to grow the shard
+      max_segments = 0x18         // buckets segments of one shard, each twice longer
+    };
+
+  /*
+   * HashNode links all the keys of the shard in one list ordered by bit-reversed hash
+   * values, and buckets are the 'dummy' nodes inside the list (split-ordered list).
+   * The nodes are never removed or moved, so the list is walked and extended without
+   * locks, and growing the buckets table just adds a new segment of buckets.
+   */
+    struct HashNode
+    {
+      AtomicNode    pchain = nullptr;
+      const size_t  sorder;               // odd for the keys, even for the dummy nodes
+
+    public:
+      HashNode( size_t so ): sorder( so ) {}
+    };
+
+  /*
+   * HashBucket is the dummy node of the bucket, linked to the list of the parent bucket
+   * on the first access.
+   */
+    struct HashBucket: HashNode
+    {
+      std::atomic_int status = 0;         // 0 - not linked, 1 - is being linked, 2 - linked
+
+    public:
+      HashBucket( size_t so ): HashNode( so ) {}
     };
 
   /*
@@ -62,7 +101,7 @@ namespace dynamic {
    * ChainHook holds key body and reference to the first element in the chain
    * of blocks indexed by incremental virtual entity indices
    */
-    struct ChainHook
+    struct ChainHook: HashNode
     {
       using LastAnchor = std::atomic<AtomicLink**>;
 
@@ -72,8 +111,6 @@ namespace dynamic {
 
       LinkAllocator         malloc;
 
-      ChainHook*            pchain;               // collisions
-
       AtomicLink            pfirst = nullptr;     // first in chain
 
       AtomicLink*           points[32];           // points cache
@@ -88,7 +125,7 @@ namespace dynamic {
       auto  data() -> char* {  return (char*)(this + 1);  }
 
     public:
-      ChainHook( const std::string_view& key, size_t hashCode, unsigned blockType, ChainHook*, Allocator );
+      ChainHook( const std::string_view& key, size_t hashCode, unsigned blockType, Allocator );
      ~ChainHook();
 
     public:
@@ -112,6 +149,32 @@ namespace dynamic {
 
     };
 
+  /*
+   * HashShard is a part of keys hash table growing independently.
+   *
+   * Inserts and lookups take no locks; the mutex only serializes growing of the shard,
+   * and the buckets of the new segment are filled by dummy nodes on the first access,
+   * so the chains stay short for any vocabulary size.
+   */
+    struct HashShard
+    {
+      std::atomic<HashBucket*>  segments[max_segments] = {};  // [0, shard_length), then twice longer
+      std::atomic<size_t>       length = 0;
+      std::atomic<size_t>       nhooks = 0;
+      std::mutex                resize;
+
+    public:
+      auto  GetBucket( size_t nbucket ) const -> HashBucket&
+      {
+        if ( nbucket < shard_length )
+          return segments[0].load( std::memory_order_acquire )[nbucket];
+
+        auto  nlevel = size_t(63 - __builtin_clzll( nbucket / shard_length ));
+
+        return segments[nlevel + 1].load( std::memory_order_acquire )[nbucket - (shard_length << nlevel)];
+      }
+    };
+
   public:
     class KeyLister;
 
@@ -140,6 +203,23 @@ namespace dynamic {
     bool  VerifyIds( unsigned ) const;
 
   protected:
+    auto  GetHook( HashShard&, const std::string_view&, size_t, unsigned ) -> ChainHook*;
+    auto  GetNode( const HashShard&, size_t ) const -> HashNode*;
+    auto  NewBuckets( size_t, size_t ) -> HashBucket*;
+    void  Rehash( HashShard& );
+
+    static  auto  BitsReverse( uint64_t u ) -> uint64_t
+    {
+      u = ((u >> 0x01) & 0x5555555555555555) | ((u & 0x5555555555555555) << 0x01);
+      u = ((u >> 0x02) & 0x3333333333333333) | ((u & 0x3333333333333333) << 0x02);
+      u = ((u >> 0x04) & 0x0f0f0f0f0f0f0f0f) | ((u & 0x0f0f0f0f0f0f0f0f) << 0x04);
+      return __builtin_bswap64( u );
+    }
+    static  auto  HighBit( size_t u ) -> size_t
+      {  return u != 0 ? size_t(1) << (63 - __builtin_clzll( u )) : 0;  }
+    static  auto  KeyOrder( size_t nhcode ) -> size_t
+      {  return BitsReverse( nhcode / shard_count ) | 1;  }
+    bool  MergeKeys( std::vector<ChainHook*>&, bool );
     void  KeysIndexer();
 
   protected:
@@ -148,12 +228,13 @@ namespace dynamic {
       ChainHook*  blocksChain;
       uint64_t    blockOffset;
       uint32_t    blockLength;
+      uint32_t    navigLength;
 
       size_t  GetBufLen() const
       {
         return ::GetBufLen( blocksChain->bkType ) + ::GetBufLen( blocksChain->ncount.load() )
            + ::GetBufLen( blockOffset )
-           + ::GetBufLen( blockLength ) + ::GetBufLen( 0 );
+           + ::GetBufLen( blockLength ) + ::GetBufLen( navigLength );
       }
       template <class O>
       O*    Serialize( O* o ) const
@@ -161,11 +242,12 @@ namespace dynamic {
         return
           ::Serialize( ::Serialize( ::Serialize( ::Serialize( ::Serialize( o, blocksChain->bkType ), blocksChain->ncount.load() ),
             blockOffset ),
-            blockLength ), 0 );
+            blockLength ), navigLength );
       }
     };
 
-    std::vector<AtomicHook, HookAllocator>    hashTable;
+    HashShard                                 hashTable[shard_count];
+    HashAllocator                             hashAlloc;
     AllocatorCast<Allocator, ChainHook>       hookAlloc;
 
     mtc::radix::tree<RadixLink,
@@ -205,10 +287,17 @@ namespace dynamic {
 
   template <class Allocator>
   BlockChains<Allocator>::BlockChains( Allocator alloc ):
-    hashTable( hash_table_size, alloc ),
+    hashAlloc( alloc ),
     hookAlloc( alloc ),
     radixTree( alloc )
   {
+    for ( auto& shard: hashTable )
+    {
+      shard.segments[0] = NewBuckets( 0, shard_length );
+      shard.length = shard_length;
+      shard.GetBucket( 0 ).status = 2;
+    }
+
     for ( keyThread = std::thread( &BlockChains<Allocator>::KeysIndexer, this ); !runThread; )
       std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
   }
@@ -218,91 +307,183 @@ namespace dynamic {
   {
     StopIt();
 
-    for ( auto& next: hashTable )
-      for ( auto tostep = next.load(), tofree = tostep; tofree != nullptr; tofree = tostep )
+    for ( auto& shard: hashTable )
+    {
+      for ( auto tostep = shard.GetBucket( 0 ).pchain.load(), tofree = tostep; tofree != nullptr; tofree = tostep )
       {
-        tostep = tofree->pchain;
-          tofree->~ChainHook();
-        hookAlloc.deallocate( tofree, 0 );
+        tostep = tofree->pchain.load();
+
+        if ( (tofree->sorder & 1) != 0 )
+        {
+          static_cast<ChainHook*>( tofree )->~ChainHook();
+          hookAlloc.deallocate( static_cast<ChainHook*>( tofree ), 0 );
+        }
       }
+      for ( size_t nlevel = 0; nlevel != max_segments && shard.segments[nlevel] != nullptr; ++nlevel )
+        hashAlloc.deallocate( shard.segments[nlevel].load(), nlevel != 0 ? shard_length << (nlevel - 1) : shard_length );
+    }
   }
 
   template <class Allocator>
   void  BlockChains<Allocator>::Insert( const std::string_view& key, uint32_t entity, const std::string_view& block, unsigned bkType )
   {
     auto  nhcode = std::hash<std::string_view>()( key );
-    auto  hindex = nhcode % hashTable.size();
-    auto& hentry = hashTable[hindex];
-    auto  hvalue = mtc::ptr::clean( hentry.load( std::memory_order_acquire ) );
+    auto& hshard = hashTable[nhcode % shard_count];
+    auto  hvalue = (ChainHook*)nullptr;
 
     // check block type; set the type value if is not set yet
     if ( bkType == unsigned(-1) )
       bkType = block.size() != 0 ? 0x10 : 0;
 
-    // lookup the collision chain for the element with searched key
-    for ( ; hvalue != nullptr; hvalue = hvalue->pchain )
-      if ( hvalue->nhCode == nhcode && *hvalue == key )
-      {
-        if ( hvalue->bkType != bkType )
-          throw std::invalid_argument( "Block type do not match the previously defined type" );
-        return hvalue->Insert( entity, block );
-      }
+    if ( (hvalue = GetHook( hshard, key, nhcode, bkType ))->bkType != bkType )
+      throw std::invalid_argument( "Block type do not match the previously defined type" );
 
-    // OK, try lock current entry with 'dirty' bit
-    while ( !hentry.compare_exchange_strong( hvalue, mtc::ptr::dirty( hvalue ),
-      std::memory_order_acq_rel,
-      std::memory_order_acquire ) ) hvalue = mtc::ptr::clean( hvalue );
+    // grow the shard if the collision chains became too long
+    if ( hshard.nhooks.load( std::memory_order_relaxed ) > hshard.length.load( std::memory_order_relaxed ) * shard_filling )
+      Rehash( hshard );
 
-    // lookup the list got again searching for existing key
-    for ( ; hvalue != nullptr; hvalue = hvalue->pchain )
-      if ( hvalue->nhCode == nhcode && *hvalue == key )
-      {
-        hentry.store( mtc::ptr::clean( hentry.load(
-          std::memory_order_acquire ) ),
-          std::memory_order_release );
+    return hvalue->Insert( entity, block );
+  }
 
-        if ( hvalue->bkType != bkType )
-          throw std::invalid_argument( "Block type do not match the previously defined type" );
+  template <class Allocator>
+  auto  BlockChains<Allocator>::Lookup( const std::string_view& key ) const -> const ChainHook*
+  {
+    auto  nhcode = std::hash<std::string_view>()( key );
+    auto& hshard = hashTable[nhcode % shard_count];
+    auto  sorder = KeyOrder( nhcode );
+    auto  hvalue = GetNode( hshard, (nhcode / shard_count) & (hshard.length.load( std::memory_order_acquire ) - 1) );
 
-        return hvalue->Insert( entity, block );
-      }
+    for ( hvalue = hvalue->pchain.load( std::memory_order_acquire ); hvalue != nullptr && hvalue->sorder <= sorder;
+      hvalue = hvalue->pchain.load( std::memory_order_acquire ) )
+    {
+      if ( hvalue->sorder == sorder && *static_cast<const ChainHook*>( hvalue ) == key )
+        return static_cast<const ChainHook*>( hvalue );
+    }
 
-    // list contains no needed entry; allocate new ChainHook for new key;
-    // for possible exceptions, unlock the entry and continue tracing
-    try
+    return nullptr;
+  }
+
+ /*
+  * GetHook( shard, key, hash, type )
+  *
+  * Finds or creates the ChainHook for the key. The new hook is linked to the list
+  * with CAS right before the first node of greater order; on the concurrent change
+  * the list is walked again from the same node, as the nodes are never removed.
+  */
+  template <class Allocator>
+  auto  BlockChains<Allocator>::GetHook( HashShard& hshard, const std::string_view& key, size_t nhcode, unsigned bkType ) -> ChainHook*
+  {
+    auto  sorder = KeyOrder( nhcode );
+    auto  pstore = GetNode( hshard, (nhcode / shard_count) & (hshard.length.load( std::memory_order_acquire ) - 1) );
+    auto  pentry = (HashNode*)nullptr;
+    auto  hvalue = (ChainHook*)nullptr;
+
+    for ( ; ; )
     {
-      new( hvalue = hookAlloc.allocate( (sizeof(ChainHook) * 2 + key.size() - 1) / sizeof(ChainHook) ) )
-        ChainHook( key, nhcode, bkType, mtc::ptr::clean( hentry.load() ), hookAlloc );
+    // find the existing key or the position to insert the new one
+      for ( pentry = pstore->pchain.load( std::memory_order_acquire ); pentry != nullptr && pentry->sorder <= sorder;
+        pentry = (pstore = pentry)->pchain.load( std::memory_order_acquire ) )
+      {
+        if ( pentry->sorder == sorder && *static_cast<ChainHook*>( pentry ) == key )
+        {
+          if ( hvalue != nullptr )
+          {
+            hvalue->~ChainHook();
+            hookAlloc.deallocate( hvalue, 0 );
+          }
+          return static_cast<ChainHook*>( pentry );
+        }
+      }
 
-      hentry.store( hvalue, std::memory_order_release );
+    // list contains no needed entry; allocate new ChainHook for new key once
+      if ( hvalue == nullptr )
+      {
+        new( hvalue = hookAlloc.allocate( (sizeof(ChainHook) * 2 + key.size() - 1) / sizeof(ChainHook) ) )
+          ChainHook( key, nhcode, bkType, hookAlloc );
+      }
 
-      keysQueue.Put( hvalue );
-      keySyncro.notify_one();
+      hvalue->pchain.store( pentry, std::memory_order_relaxed );
+
+      if ( pstore->pchain.compare_exchange_strong( pentry, hvalue, std::memory_order_release, std::memory_order_relaxed ) )
+        break;
     }
-    catch ( ... )
+
+    hshard.nhooks.fetch_add( 1, std::memory_order_relaxed );
+
+    keysQueue.Put( hvalue );
+    keySyncro.notify_one();
+
+    return hvalue;
+  }
+
+ /*
+  * GetNode( shard, bucket )
+  *
+  * Returns the dummy node of the bucket, first inserting it to the list of the parent
+  * bucket (the one with the highest bit cleared) if the bucket is not linked yet. While
+  * the other thread links the bucket, the parent's node is returned: the keys of the
+  * bucket are in the parent's list.
+  */
+  template <class Allocator>
+  auto  BlockChains<Allocator>::GetNode( const HashShard& hshard, size_t nbucket ) const -> HashNode*
+  {
+    auto& bucket = hshard.GetBucket( nbucket );
+    auto  status = bucket.status.load( std::memory_order_acquire );
+    auto  pstore = (HashNode*)nullptr;
+    auto  pentry = (HashNode*)nullptr;
+
+    if ( status == 2 )
+      return &bucket;
+
+    pstore = GetNode( hshard, nbucket & ~HighBit( nbucket ) );
+
+    if ( status != 0 || !bucket.status.compare_exchange_strong( status, 1 ) )
+      return pstore;
+
+    for ( ; ; )
     {
-      hentry.store( mtc::ptr::clean( hentry.load(
-        std::memory_order_acquire) ),
-        std::memory_order_release );
-      throw;
+      for ( pentry = pstore->pchain.load( std::memory_order_acquire ); pentry != nullptr && pentry->sorder < bucket.sorder; )
+        pentry = (pstore = pentry)->pchain.load( std::memory_order_acquire );
+
+      bucket.pchain.store( pentry, std::memory_order_relaxed );
+
+      if ( pstore->pchain.compare_exchange_strong( pentry, &bucket, std::memory_order_release, std::memory_order_relaxed ) )
+        break;
     }
-    return hvalue->Insert( entity, block );
+
+    return bucket.status.store( 2, std::memory_order_release ), &bucket;
   }
 
   template <class Allocator>
-  auto  BlockChains<Allocator>::Lookup( const std::string_view& key ) const -> const ChainHook*
+  auto  BlockChains<Allocator>::NewBuckets( size_t first, size_t length ) -> HashBucket*
   {
-    auto  nhcode = std::hash<std::string_view>()( key );
-    auto  hindex = nhcode % hashTable.size();
-    auto& hentry = hashTable[hindex];
-    auto  hvalue = mtc::ptr::clean( hentry.load( std::memory_order_acquire ) );
+    auto  buckets = hashAlloc.allocate( length );
 
-  // first try find existing block in the hash chain
-    for ( ; hvalue != nullptr; hvalue = hvalue->pchain )
-      if ( hvalue->nhCode == nhcode && *hvalue == key )
-        return hvalue;
+    for ( size_t i = 0; i != length; ++i )
+      new( buckets + i ) HashBucket( BitsReverse( first + i ) );
 
-    return nullptr;
+    return buckets;
+  }
+
+ /*
+  * Rehash( shard )
+  *
+  * Doubles the buckets count of the shard by adding the next segment of buckets; the
+  * keys are not moved. Concurrent calls do not wait for the one growing the shard.
+  */
+  template <class Allocator>
+  void  BlockChains<Allocator>::Rehash( HashShard& hshard )
+  {
+    auto  exlock = std::unique_lock<std::mutex>( hshard.resize, std::try_to_lock );
+    auto  oldlen = hshard.length.load( std::memory_order_relaxed );
+    auto  nlevel = size_t(64 - __builtin_clzll( oldlen / shard_length ));
+
+    // check if the shard is already grown by another thread
+    if ( !exlock.owns_lock() || nlevel >= max_segments || hshard.nhooks.load( std::memory_order_relaxed ) <= oldlen * shard_filling )
+      return;
+
+    hshard.segments[nlevel].store( NewBuckets( oldlen, oldlen ), std::memory_order_release );
+    hshard.length.store( oldlen * 2, std::memory_order_release );
   }
 
   template <class Allocator>
@@ -364,17 +545,24 @@ namespace dynamic {
   template <class Allocator>
   bool  BlockChains<Allocator>::Verify() const
   {
-    for ( auto& next: hashTable )
-      for ( auto verify = next.load(); verify != nullptr; verify = verify->pchain )
-        if ( !verify->Verify() )
+    for ( auto& shard: hashTable )
+      for ( auto verify = (const HashNode*)&shard.GetBucket( 0 ); verify != nullptr; verify = verify->pchain.load() )
+      {
+        auto  follow = verify->pchain.load();
+
+        if ( follow != nullptr && follow->sorder < verify->sorder )
+          return false;
+        if ( (verify->sorder & 1) != 0 && !static_cast<const ChainHook*>( verify )->Verify() )
           return false;
+      }
     return true;
   }
 
  /*
   * Serialize( index, chain )
   *
-  * Serializes the created inverted index to storage.
+  * Serializes the created inverted index to storage in the final layout of the merged
+  * indices: each block is followed by its DocDowels navigation points.
   */
   template <class Allocator>
   template <class O1, class O2>
@@ -385,12 +573,17 @@ namespace dynamic {
 # if defined( VERIFY_KEY_COUNT )
     // для уверенности в том, что KeysIndexer ничего не промотал, проверить совпадение количества
     // ключей в hash-table и в radixTree
-    for ( auto& next: hashTable )
-      for ( auto tostep = next.load(); tostep != nullptr; tostep = tostep->pchain.load() )
-        if ( radixTree.Search( { tostep->data(), tostep->cchkey } ) == nullptr )
+    for ( auto& shard: hashTable )
+      for ( auto tonext = (const HashNode*)&shard.GetBucket( 0 ); tonext != nullptr; tonext = tonext->pchain.load() )
+        if ( (tonext->sorder & 1) != 0 )
         {
-          fprintf( stderr, "key '%s' not found in radix tree\n",
-            std::string( tostep->data(), tostep->cchkey ).c_str() );
+          auto  tostep = static_cast<const ChainHook*>( tonext );
+
+          if ( radixTree.Search( { tostep->data(), tostep->cchkey } ) == nullptr )
+          {
+            fprintf( stderr, "key '%s' not found in radix tree\n",
+              std::string( tostep->data(), tostep->cchkey ).c_str() );
+          }
         }
 # endif   // VERIFY_KEY_COUNT
 
@@ -399,6 +592,7 @@ namespace dynamic {
     {
       auto    lastId = uint32_t(0);
       auto    length = uint32_t(0);
+      auto    points = DocDowels();
       char    docbuf[0x20];
       size_t  doclen;
 
@@ -415,7 +609,7 @@ namespace dynamic {
             doclen = ::Serialize( docbuf, p->entity - lastId - 1 ) - docbuf;
               length += doclen;
             chain = ::Serialize( chain, docbuf, doclen );
-              lastId = p->entity;
+              points.Add( lastId = p->entity, length, doclen );
           }
       }
         else
@@ -427,10 +621,15 @@ namespace dynamic {
               length += doclen + p->lblock;
             chain = ::Serialize( ::Serialize( chain,
               docbuf, doclen ), p->data(), p->lblock );
-            lastId = p->entity;
+            points.Add( lastId = p->entity, length, doclen + p->lblock );
           }
       }
+
+    // store navigation points after the block
+      chain = points.Serialize( chain );
+
       offset += (next->value.blockLength = length);
+      offset += (next->value.navigLength = points.GetBufLen());
     }
 
   // store radix tree
@@ -456,36 +655,87 @@ namespace dynamic {
     return true;
   }
 
+ /*
+  * MergeKeys( keys, wait )
+  *
+  * Sorts the batch of new keys and inserts it to the radix tree under one exclusive
+  * lock. Without wait, returns false if the tree is locked by key listers, leaving
+  * the batch to be merged later.
+  */
+  template <class Allocator>
+  bool  BlockChains<Allocator>::MergeKeys( std::vector<ChainHook*>& keyset, bool wait )
+  {
+    auto  exlock = mtc::make_unique_lock( radixLock, std::defer_lock );
+
+    std::sort( keyset.begin(), keyset.end(), []( const ChainHook* a, const ChainHook* b )
+      {  return std::string_view( a->data(), a->cchkey ) < std::string_view( b->data(), b->cchkey );  } );
+
+    if ( wait ) exlock.lock();
+      else
+    if ( !exlock.try_lock() )
+      return false;
+
+    for ( auto addkey: keyset )
+      radixTree.Insert( { addkey->data(), addkey->cchkey }, { addkey, 0, 0, 0 } );
+
+    return keyset.clear(), true;
+  }
+
  /*
   * Shadow keys indexer
   *
-  * Wakes up on signals, indexes all the new keys from the queue, stops after
-  * all the keys are indexed and runThread is false.
+  * Wakes up on signals, drains the new keys queue to the batch and merges the batch
+  * to the radix tree; stops after all the keys are indexed and runThread is false.
+  *
+  * The queue is drained even if the tree is locked by key listers, so the writers
+  * do not stall on the filled queue. After merge_keys_tries failed attempts the batch
+  * is merged with the blocking lock, so a stream of listers never starves the merge.
   */
   template <class Allocator>
   void  BlockChains<Allocator>::KeysIndexer()
   {
-    auto        locker = mtc::make_unique_lock( radixLock );
+    auto        waiter = std::mutex();
+    auto        locker = mtc::make_unique_lock( waiter );
+    auto        keyset = std::vector<ChainHook*>();
+    auto        nfails = size_t(0);
     ChainHook*  addkey;
 
     pthread_setname_np( pthread_self(), "KeysIndexer" );
 
-    for ( runThread = true; runThread; )
+    for ( runThread = true; ; )
     {
-      keySyncro.wait_for( locker,
-        std::chrono::milliseconds( 100 ) );
-      while ( keysQueue.Get( addkey ) )
-        radixTree.Insert( { addkey->data(), addkey->cchkey }, { addkey, 0, 0 } );
+      auto  finish = !runThread;
+      auto  nfetch = size_t(0);
+
+      for ( ; keysQueue.Get( addkey ); ++nfetch )
+        keyset.push_back( addkey );
+
+      if ( !keyset.empty() && !MergeKeys( keyset, finish || nfails >= merge_keys_tries ) )
+      {
+        keySyncro.wait_for( locker, std::chrono::milliseconds( 1 ) );
+        ++nfails;
+      }
+        else
+      if ( finish )
+        break;
+      else
+      {
+        nfails = 0;
+
+      // on the bursts of new keys check the queue again without waiting
+        if ( nfetch < ring_buffer_size / 2 )
+          keySyncro.wait_for( locker, std::chrono::milliseconds( 100 ) );
+      }
     }
   }
 
   template <class Allocator>
-  BlockChains<Allocator>::ChainHook::ChainHook( const std::string_view& key, size_t hashCode, unsigned b, ChainHook* p, Allocator m ):
+  BlockChains<Allocator>::ChainHook::ChainHook( const std::string_view& key, size_t hashCode, unsigned b, Allocator m ):
+    HashNode( KeyOrder( hashCode ) ),
     nhCode( hashCode ),
     bkType( b ),
     cchkey( key.size() ),
-    malloc( m ),
-    pchain( p )
+    malloc( m )
   {
     memset( points, 0, sizeof(points) );
     memcpy( data(), key.data(), cchkey );
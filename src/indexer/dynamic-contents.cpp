@@ -59,7 +59,6 @@ namespace dynamic {
 
     EntTable&                       entities;
     Contents&                       contents;
-    Bitmap<Allocator>               shadowed;
 
   };
 
@@ -174,8 +173,7 @@ namespace dynamic {
     memLimit( maxAllocate ),
     pStorage( storageSink ),
     entities( *memArena.Create<EntTable>( maxEntities, this, pStorage != nullptr ? pStorage->Packages() : nullptr ) ),
-    contents( *memArena.Create<Contents>() ),
-    shadowed( maxEntities, memArena.get_allocator<char>() )
+    contents( *memArena.Create<Contents>() )
   {
   }
 
@@ -191,9 +189,7 @@ namespace dynamic {
 
   bool  ContentsIndex::DelEntity( EntityId id )
   {
-    uint32_t  del_id = entities.DelEntity( id );
-
-    return del_id != (uint32_t)-1 ? shadowed.Set( del_id ), true : false;
+    return entities.DelEntity( id ) != uint32_t(-1);
   }
 
   auto  ContentsIndex::SetEntity( EntityId id, const mtc::span<const EntryView>& keys,
@@ -201,7 +197,6 @@ namespace dynamic {
   {
     auto  entity = mtc::api<EntTable::Entity>();
     auto  bodies = pStorage != nullptr ? pStorage->Packages() : nullptr;
-    auto  del_id = uint32_t{};
     auto  bdlPos = int64_t(-1);
     auto  ent_id = uint32_t{};
 
@@ -213,15 +208,11 @@ namespace dynamic {
     if ( bodies != nullptr && !beef.empty() )
       bdlPos = bodies->Put( beef.data(), beef.size() );
 
-  // create the entity
-    entity = entities.SetEntity( id, xtra, &del_id );
+  // create the entity; the replaced one is marked as deleted in the table
+    entity = entities.SetEntity( id, xtra );
       entity->SetPackPos( bdlPos );
     ent_id = entity->GetIndex();
 
-  // check if any entities deleted
-    if ( del_id != uint32_t(-1) )
-      shadowed.Set( del_id );
-
   // process contents indexing
     for ( auto& next: keys )
       contents.Insert( next.key, ent_id, next.val, next.bid );
@@ -274,6 +265,12 @@ namespace dynamic {
       throw std::logic_error( "output storage is not defined, but Commit() was called" );
 
   // finalize keys thread and remove all the deleted elements from lists
+    auto  shadowed = Bitmap<Allocator>( entities.GetEntityCount() + 1, memArena.get_allocator<char>() );
+
+    for ( uint32_t index = 1; index <= entities.GetEntityCount(); ++index )
+      if ( entities.IsDeleted( index ) )
+        shadowed.Set( index );
+
     contents.StopIt().Remove( shadowed );
 
 //    contents.VerifyIds( GetMaxIndex() );
@@ -307,7 +304,7 @@ namespace dynamic {
 
   auto  ContentsIndex::Entities::Find( uint32_t id ) -> Reference
   {
-    while ( pchain != nullptr && (pchain->entity < id || parent->shadowed.Get( pchain->entity )) )
+    while ( pchain != nullptr && (pchain->entity < id || parent->entities.IsDeleted( pchain->entity )) )
       pchain = pchain->p_next.load();
 
     if ( pchain != nullptr )
@@ -4,8 +4,11 @@
 # include "../../exceptions.hpp"
 # include "../../primes.hpp"
 # include "../../compat.hpp"
+# include "entities-image.hpp"
+# include <mtc/recursive_shared_mutex.hpp>
 # include <mtc/ptrpatch.h>
 # include <mtc/wcsstr.h>
+# include <shared_mutex>
 # include <type_traits>
 # include <stdexcept>
 # include <vector>
@@ -19,6 +22,13 @@ namespace dynamic {
   template <class Allocator = std::allocator<char>>
   class EntityTable
   {
+    enum: size_t
+    {
+      segment_base = 0x400,     // entities in the first segment, next ones are twice larger
+      segment_count = 22,       // segment_base * 2^segment_count covers any uint32_t index
+      initial_hash = 0x1000     // initial hash table size for unlimited tables
+    };
+
   public:
     class Iterator;
 
@@ -76,6 +86,7 @@ namespace dynamic {
       auto  GetPackPos() const -> int64_t {  return packPos;  }
 
     public:     // serialization
+      size_t  GetBufLen() const;
       template <class O>
       O*  Serialize( O* ) const;
 
@@ -84,7 +95,7 @@ namespace dynamic {
       extras                extra;                // document attributes
       uint32_t              index = -1;          // order of creation, default 0
       int64_t               packPos = -1;
-      uint64_t              version;
+      uint64_t              version = 0;
 
       mtc::Iface*           ownerPtr = nullptr;
       IStorage::IBundleRepo* docStore = nullptr;
@@ -93,11 +104,22 @@ namespace dynamic {
     };
 
   public:
+   /*
+    * EntityTable( size_limit, ... )
+    *
+    * Creates the table for up to size_limit - 1 entities; with size_limit == 0 the table
+    * grows by segments without the count limit, and the index size is limited by the
+    * memory allocated only.
+    *
+    * The growing table pays for the unlimited size with the shared hashLock taken by
+    * each access by id, as the rehash relinks the collision chains in place; the tables
+    * of limited size have the hash for all the entities and take no locks.
+    */
     EntityTable( uint32_t size_limit, mtc::Iface* owner, IStorage::IBundleRepo* store, Allocator alloc = Allocator() );
    ~EntityTable();
 
-    auto  GetMaxEntities() const -> uint32_t  {  return uint32_t(entStore.size());  }
-    auto  GetEntityCount() const -> uint32_t  {  return uint32_t(ptrStore.load() - (Entity*)entStore.data() - 1);  }
+    auto  GetMaxEntities() const -> uint32_t  {  return maxCount;  }
+    auto  GetEntityCount() const -> uint32_t  {  return entCount.load() - 1;  }
 
   public:
   /*
@@ -127,6 +149,13 @@ namespace dynamic {
     auto  SetEntity( const std::string_view&, const std::string_view& = {}, uint32_t* = nullptr ) -> mtc::api<Entity>;
     auto  SetExtras( const std::string_view&, const std::string_view& = {} ) -> mtc::api<Entity>;
 
+  /*
+   *  ::IsDeleted( uint32_t )
+   *  Checks if the entity with index passed is deleted or replaced.
+   */
+    bool  IsDeleted( uint32_t index ) const
+      {  return index < entCount.load() && getEntity( index ).index == uint32_t(-1);  }
+
   public:      // iterator access
     auto  GetIterator( uint32_t ) const -> Iterator;
     auto  GetIterator( const std::string_view& ) const -> Iterator;
@@ -136,6 +165,11 @@ namespace dynamic {
     O*  Serialize( O* o ) const;
 
   protected:
+    using EntityHolder = typename std::aligned_storage<sizeof(Entity), alignof(Entity)>::type;
+    using AtomicEntity = std::atomic<Entity*>;
+    using AtomicHolder = std::atomic<EntityHolder*>;
+    using StrHashTable = std::vector<AtomicEntity, AllocatorCast<Allocator, AtomicEntity>>;
+
     template <class Table>
     using EntityOf = typename std::conditional<std::is_const<Table>::value, const Entity, Entity>::type;
 
@@ -143,10 +177,33 @@ namespace dynamic {
     auto  next_by_id( uint32_t id ) const -> uint32_t;
 
   // access helpers
+    static  auto  segmentOf( uint32_t index ) -> unsigned
+      {  return 63 - __builtin_clzll( uint64_t(index) / segment_base + 1 );  }
+    static  auto  offsetOf( uint32_t index, unsigned nseg ) -> size_t
+      {  return index - segment_base * ((size_t(1) << nseg) - 1);  }
+
     auto  getEntity( uint32_t index ) const -> const Entity&
-      {  return *(const Entity*)(index + entStore.data());  }
+      {
+        auto  nseg = segmentOf( index );
+        return *(const Entity*)(entStore[nseg].load( std::memory_order_acquire ) + offsetOf( index, nseg ));
+      }
     auto  getEntity( uint32_t index )       -> Entity&
-      {  return *(      Entity*)(index + entStore.data());  }
+      {
+        auto  nseg = segmentOf( index );
+        return *(      Entity*)(entStore[nseg].load( std::memory_order_acquire ) + offsetOf( index, nseg ));
+      }
+
+    auto  getHashEntry( const std::string_view& id ) const -> AtomicEntity&
+      {  return const_cast<AtomicEntity&>( entTable[std::hash<std::string_view>{}( id ) % entTable.size()] );  }
+
+    auto  shareTable() const -> std::shared_lock<std::shared_mutex>
+      {
+        return growHash ? std::shared_lock<std::shared_mutex>( hashLock ) :
+          std::shared_lock<std::shared_mutex>( hashLock, std::defer_lock );
+      }
+
+    void  allocSegment( unsigned );
+    void  rehashTable();
 
   // get implementation
     template <class S>
@@ -155,16 +212,13 @@ namespace dynamic {
     static  auto  getEntity( S&, const std::string_view& ) -> mtc::api<EntityOf<S>>;
 
   protected:
-    using EntityHolder = typename std::aligned_storage<sizeof(Entity), alignof(Entity)>::type;
-    using AtomicEntity = std::atomic<Entity*>;
-    using EntityVector = std::vector<EntityHolder, AllocatorCast<Allocator, EntityHolder>>;
-    using StrHashTable = std::vector<AtomicEntity, AllocatorCast<Allocator, AtomicEntity>>;
-
-    const size_t EntityHolderSize = sizeof(EntityHolder);
-
-    EntityVector   entStore;  // the entities storage
-    AtomicEntity   ptrStore;
-    StrHashTable   entTable;
+    AllocatorCast<Allocator, EntityHolder>  memAlloc;
+    AtomicHolder                            entStore[segment_count];  // the entities storage segments
+    std::atomic<uint32_t>                   entCount;                 // the next entity index
+    const uint32_t                          maxCount;
+    const bool                              growHash;                 // is rehashed on growing
+    StrHashTable                            entTable;
+    mutable std::shared_mutex               hashLock;                 // exclusive for rehash only
 
     mtc::Iface*           ptrOwner = nullptr;
     IStorage::IBundleRepo* docStore = nullptr;
@@ -233,6 +287,14 @@ namespace dynamic {
   auto  EntityTable<Allocator>::Entity::SetVersion( uint64_t qw ) -> Entity&
     {  return version = qw, *this;  };
 
+  template <class Allocator>
+  size_t  EntityTable<Allocator>::Entity::GetBufLen() const
+  {
+    return ::GetBufLen( index ) + ::GetBufLen( version ) + ::GetBufLen( packPos + 1 )
+      + ::GetBufLen( id.size() ) + id.size()
+      + ::GetBufLen( extra.size() ) + extra.size();
+  }
+
   template <class Allocator>
   template <class O>
   O*  EntityTable<Allocator>::Entity::Serialize( O* o ) const
@@ -248,21 +310,82 @@ namespace dynamic {
 
   template <class Allocator>
   EntityTable<Allocator>::EntityTable( uint32_t size_limit, mtc::Iface* owner, IStorage::IBundleRepo* store, Allocator alloc ):
-    entStore( size_limit, alloc ),
-    ptrStore( &getEntity( 1 ) ),
-    entTable( UpperPrime( size_limit ), alloc ),
+    memAlloc( alloc ),
+    entCount( 1 ),
+    maxCount( size_limit != 0 ? size_limit : uint32_t(segment_base * ((size_t(1) << segment_count) - 1)) ),
+    growHash( size_limit == 0 ),
+    entTable( UpperPrime( size_limit != 0 ? size_limit : initial_hash ), alloc ),
     ptrOwner( owner ),
     docStore( store )
   {
-    new( entStore.data() )
+    for ( auto& next: entStore )
+      next.store( nullptr );
+
+    allocSegment( 0 );
+
+    new( &getEntity( 0 ) )
       Entity( alloc );
   }
 
   template <class Allocator>
   EntityTable<Allocator>::~EntityTable()
   {
-    for ( auto beg = &getEntity( 0 ), end = ptrStore.load(); beg != end; ++beg )
-      beg->~Entity();
+    for ( uint32_t index = 0, limit = entCount.load(); index != limit; ++index )
+      getEntity( index ).~Entity();
+
+    for ( size_t nseg = 0; nseg != segment_count; ++nseg )
+      if ( entStore[nseg].load() != nullptr )
+        memAlloc.deallocate( entStore[nseg].load(), segment_base << nseg );
+  }
+
+ /*
+  *  EntityTable::allocSegment( nseg )
+  *
+  *  Allocates the storage segment if not allocated yet; the concurrent allocations
+  *  are resolved by CAS, the looser releases it's segment.
+  */
+  template <class Allocator>
+  void  EntityTable<Allocator>::allocSegment( unsigned nseg )
+  {
+    auto  pstore = entStore[nseg].load( std::memory_order_acquire );
+
+    if ( pstore == nullptr )
+    {
+      auto  palloc = memAlloc.allocate( segment_base << nseg );
+
+      if ( !entStore[nseg].compare_exchange_strong( pstore, palloc ) )
+        memAlloc.deallocate( palloc, segment_base << nseg );
+    }
+  }
+
+ /*
+  *  EntityTable::rehashTable()
+  *
+  *  Relinks the entities to the hash table about twice larger than the count
+  *  of entities; called without the shared lock of the hash table.
+  */
+  template <class Allocator>
+  void  EntityTable<Allocator>::rehashTable()
+  {
+    auto  exlock = mtc::make_unique_lock( hashLock );
+    auto  ncount = entCount.load();
+
+    if ( ncount <= 2 * entTable.size() )
+      return;
+
+    auto  newTab = StrHashTable( UpperPrime( 2 * ncount ), entTable.get_allocator() );
+
+    for ( auto& next: entTable )
+      for ( auto entity = next.load(), toStep = entity; entity != nullptr; entity = toStep )
+      {
+        auto& hentry = newTab[std::hash<std::string_view>{}( { entity->id.data(), entity->id.size() } ) % newTab.size()];
+
+        toStep = entity->collision.load();
+          entity->collision.store( hentry.load() );
+        hentry.store( entity );
+      }
+
+    entTable.swap( newTab );
   }
 
  /*
@@ -274,8 +397,9 @@ namespace dynamic {
   template <class Allocator>
   auto  EntityTable<Allocator>::DelEntity( const std::string_view& id ) -> uint32_t
   {
-    auto  hindex = std::hash<std::string_view>{}( { id.data(), id.size() } ) % entTable.size();
-    auto* hentry = &entTable[hindex];
+    auto  shlock = shareTable();
+    auto& hstart = getHashEntry( id );
+    auto* hentry = &hstart;
     auto  hvalue = mtc::ptr::clean( hentry->load() );
     auto  del_id = uint32_t(-1);
 
@@ -300,17 +424,16 @@ namespace dynamic {
       }
 
   // unblock the entry
-    entTable[hindex].store( mtc::ptr::clean( entTable[hindex].load() ) );
+    hstart.store( mtc::ptr::clean( hstart.load() ) );
     return del_id;
   }
 
   template <class Allocator>
   auto  EntityTable<Allocator>::SetEntity( const std::string_view& id, const std::string_view& xtras, uint32_t* deleted ) -> mtc::api<Entity>
   {
-    auto  hindex = std::hash<std::string_view>{}( { id.data(), id.size() } ) % entTable.size();
-    auto* hentry = &entTable[hindex];
-    auto  hvalue = mtc::ptr::clean( hentry->load() );
-    auto  entptr = ptrStore.load();
+    auto  shlock = std::shared_lock<std::shared_mutex>();
+    auto  entidx = entCount.load();
+    auto  entptr = (Entity*)nullptr;
 
     if ( id.empty() )
       throw std::invalid_argument( "id is empty" );
@@ -323,15 +446,18 @@ namespace dynamic {
   // finish with entptr -> allocated entry
     for ( ;; )
     {
-      if ( entptr >= &getEntity( 0 ) + entStore.size() )
-        throw index_overflow( mtc::strprintf( "index size achieved limit of %d documents", entStore.size() ) );
+      if ( entidx >= maxCount )
+        throw index_overflow( mtc::strprintf( "index size achieved limit of %u documents", maxCount ) );
+
+    // the segment is allocated before the index is published to readers
+      allocSegment( segmentOf( entidx ) );
 
-      if ( !ptrStore.compare_exchange_weak( entptr, entptr + 1 ) )
+      if ( !entCount.compare_exchange_weak( entidx, entidx + 1 ) )
         continue;
 
-      (new( entptr ) Entity( entTable.get_allocator() ))->
+      (entptr = new( &getEntity( entidx ) ) Entity( entTable.get_allocator() ))->
         SetId( id ).
-        SetIndex( uint32_t(entptr - &getEntity( 0 )) ).
+        SetIndex( entidx ).
         SetExtra( xtras ).
         SetOwner( ptrOwner ).
         SetStore( docStore );
@@ -342,6 +468,12 @@ namespace dynamic {
   // ensure the element may be created with docid == -1 meaning it is 'deleted'
   //
   // Now block the hash table entry from modifications outside and create reference to document
+    shlock = shareTable();
+
+    auto& hstart = getHashEntry( id );
+    auto* hentry = &hstart;
+    auto  hvalue = mtc::ptr::clean( hentry->load() );
+
     while ( !hentry->compare_exchange_weak( hvalue, mtc::ptr::dirty( hvalue ) ) )
       hvalue = mtc::ptr::clean( hvalue );
 
@@ -359,7 +491,7 @@ namespace dynamic {
 
       // check if deleted document index is requested
         if ( deleted != nullptr )
-          *deleted = uint32_t(hvalue - &getEntity( 0 ));
+          *deleted = hvalue->index;
 
       // mark excluded document as deleted
         hvalue->index = uint32_t(-1);
@@ -372,8 +504,15 @@ namespace dynamic {
       }
 
     // set up the document chain
-    entptr->collision.store( mtc::ptr::clean( entTable[hindex].load() ) );
-      entTable[hindex].store( entptr );
+    entptr->collision.store( mtc::ptr::clean( hstart.load() ) );
+      hstart.store( entptr );
+
+  // grow the hash table if the collision chains became too long
+    if ( growHash && entidx > 2 * entTable.size() )
+    {
+      shlock.unlock();
+      rehashTable();
+    }
 
     return entptr;
   }
@@ -381,8 +520,8 @@ namespace dynamic {
   template <class Allocator>
   auto  EntityTable<Allocator>::SetExtras( const std::string_view& id, const std::string_view& xtras ) -> mtc::api<Entity>
   {
-    auto  hindex = std::hash<std::string_view>{}( { id.data(), id.size() } ) % entTable.size();
-    auto& hentry = entTable[hindex];
+    auto  shlock = shareTable();
+    auto& hentry = getHashEntry( id );
     auto  hvalue = mtc::ptr::clean( hentry.load() );
 
     if ( id.empty() )
@@ -426,21 +565,21 @@ namespace dynamic {
   {
     auto  entptr = decltype(&self.getEntity( index )){};
 
-    if ( index == 0 || index == uint32_t(-1) || index >= self.entStore.size() )
+    if ( index == 0 || index == uint32_t(-1) || index >= self.maxCount )
       throw std::invalid_argument( "index out of range" );
 
-    if ( (entptr = &self.getEntity( index )) >= self.ptrStore.load() )
+    if ( index >= self.entCount.load() )
       return nullptr;
 
-    return entptr->index != uint32_t(-1) ? entptr : nullptr;
+    return (entptr = &self.getEntity( index ))->index != uint32_t(-1) ? entptr : nullptr;
   }
 
   template <class Allocator>
   template <class S>
   auto  EntityTable<Allocator>::getEntity( S& self, const std::string_view& id ) -> mtc::api<EntityOf<S>>
   {
-    auto  hindex = std::hash<std::string_view>{}( { id.data(), id.size() } ) % self.entTable.size();
-    auto  docptr = mtc::ptr::clean( self.entTable[hindex].load() );
+    auto  shlock = self.shareTable();
+    auto  docptr = mtc::ptr::clean( self.getHashEntry( id ).load() );
 
     // search matching document
     while ( docptr != nullptr && docptr->id != id )
@@ -453,13 +592,12 @@ namespace dynamic {
   template <class Allocator>
   auto  EntityTable<Allocator>::GetIterator( uint32_t id ) const -> Iterator
   {
-    auto  beg = &getEntity( id );
-    auto  end = ptrStore.load();
+    auto  end = entCount.load();
 
-    while ( beg < end && beg->index == uint32_t(-1) )
-      ++beg;
+    while ( id < end && getEntity( id ).index == uint32_t(-1) )
+      ++id;
 
-    return Iterator( *this, uint32_t(beg - &getEntity( 0 )), &EntityTable::next_by_ix );
+    return Iterator( *this, id, &EntityTable::next_by_ix );
   }
 
   template <class Allocator>
@@ -468,12 +606,16 @@ namespace dynamic {
     auto  minone = (const Entity*)nullptr;
 
   // locate minimal entity with id >= passed one
-    for ( auto beg = &getEntity( 1 ), end = (const Entity*)ptrStore.load(); beg != end; ++beg )
+    for ( uint32_t index = 1, end = entCount.load(); index < end; ++index )
+    {
+      auto  beg = &getEntity( index );
+
       if ( beg->index != uint32_t(-1) && beg->id >= id )
         if ( minone == nullptr || beg->id < minone->id )
           minone = beg;
+    }
 
-    return Iterator( *this, minone != nullptr ? uint32_t(minone - &getEntity( 0 )) : uint32_t(-1),
+    return Iterator( *this, minone != nullptr ? minone->index : uint32_t(-1),
       &EntityTable::next_by_id );
   }
 
@@ -482,27 +624,35 @@ namespace dynamic {
   O*  EntityTable<Allocator>::Serialize( O* o ) const
   {
     auto  delEnt = Entity( entTable.get_allocator() );
+    auto  images = EntitiesImage::Builder();
 
     if ( (o = delEnt.Serialize( o )) == nullptr )
       return nullptr;
 
-    for ( auto ptr = &getEntity( 1 ), end = (const Entity*)ptrStore.load(); ptr != end && o != nullptr; ++ptr )
-      if ( ptr->index != uint32_t(-1) ) o = ptr->Serialize( o );
-        else o = delEnt.Serialize( o );
+    images.Add( delEnt.GetBufLen(), {}, delEnt.index );
 
-    return o;
+  // serialize the records registering the offsets and ids for the static index
+    for ( uint32_t index = 1, end = entCount.load(); index < end && o != nullptr; ++index )
+    {
+      auto& record = getEntity( index );
+      auto& entity = record.index != uint32_t(-1) ? record : delEnt;
+
+      images.Add( entity.GetBufLen(), { entity.id.data(), entity.id.size() }, entity.index );
+        o = entity.Serialize( o );
+    }
+
+    return o != nullptr ? images.Serialize( o ) : nullptr;
   }
 
   template <class Allocator>
   auto  EntityTable<Allocator>::next_by_ix( uint32_t id ) const -> uint32_t
   {
-    auto  ptrbeg = &getEntity( 0 );
-    auto  ptrend = ptrStore.load();
+    auto  ixlimit = entCount.load();
 
-    for ( ++id; ptrbeg + id < ptrend && ptrbeg[id].index == uint32_t(-1); ++id )
+    for ( ++id; id < ixlimit && getEntity( id ).index == uint32_t(-1); ++id )
       (void)NULL;
 
-    return ptrbeg + id < ptrend ? id : uint32_t(-1);
+    return id < ixlimit ? id : uint32_t(-1);
   }
 
   template <class Allocator>
@@ -511,10 +661,14 @@ namespace dynamic {
     auto  lastid = &getEntity( id ).id;
     auto  select = (const Entity*)nullptr;
 
-    for ( auto beg = &getEntity( 1 ), end = (const Entity*)ptrStore.load(); beg != end; ++beg )
+    for ( uint32_t index = 1, end = entCount.load(); index < end; ++index )
+    {
+      auto  beg = &getEntity( index );
+
       if ( beg->index != uint32_t(-1) && beg->id > *lastid )
         if ( select == nullptr || beg->id < select->id )
           lastid = &(select = beg)->id;
+    }
 
     return select != nullptr ? select->index : uint32_t(-1);
   }
@@ -524,7 +678,7 @@ namespace dynamic {
   template <class Allocator>
   auto  EntityTable<Allocator>::Iterator::Curr() -> mtc::api<const Entity>
   {
-    auto  maxIndex = entityTable->ptrStore.load() - &entityTable->getEntity( 0 );
+    auto  maxIndex = entityTable->entCount.load();
 
     while ( entityIndex < maxIndex && entityTable->getEntity( entityIndex ).index == uint32_t(-1) )
       ++entityIndex;
@@ -0,0 +1,202 @@
+# if !defined( __structo_src_indexer_entities_image_hpp__ )
+# define __structo_src_indexer_entities_image_hpp__
+# include <mtc/serialize.h>
+# include <string_view>
+# include <cstring>
+# include <cstdint>
+# include <vector>
+
+namespace structo {
+namespace indexer {
+
+ /*
+  * EntitiesImage
+  *
+  * Навигационный хвост сериализованной таблицы сущностей, позволяющий статическому
+  * индексу работать с отображённым в память файлом без разбора записей:
+  *
+  *   records[count]    - сериализованные сущности, запись i соответствует индексу i;
+  *   offsets[count]    - смещения записей, по offsetLen (4 или 8) байт;
+  *   hashTab[hashLen]  - открытая адресация, uint32_t индексы сущностей, 0 - пусто;
+  *   footer            - сигнатура, длина записей, count, hashLen, offsetLen.
+  *
+  * Все числа хранятся в little-endian, выравнивание не требуется.
+  */
+  struct EntitiesImage
+  {
+    enum: size_t
+    {
+      footer_size = 32
+    };
+
+    struct Footer
+    {
+      uint64_t  recordsLen = 0;
+      uint32_t  count = 0;
+      uint32_t  hashLen = 0;
+      uint32_t  offsetLen = 0;
+    };
+
+    class Builder;
+
+   /*
+    * HashOf( id )
+    *
+    * FNV-1a; the hash is stored on disk, so std::hash<> may not be used.
+    */
+    static  auto  HashOf( const std::string_view& id ) -> uint64_t
+    {
+      auto  hvalue = uint64_t(0xcbf29ce484222325);
+
+      for ( auto ch: id )
+        hvalue = (hvalue ^ uint8_t(ch)) * 0x100000001b3;
+
+      return hvalue;
+    }
+
+   /*
+    * HashLen( count )
+    *
+    * Power of 2 keeping the hash table at most half full.
+    */
+    static  auto  HashLen( uint32_t count ) -> uint32_t
+    {
+      auto  length = uint32_t(4);
+
+      while ( length < 2 * uint64_t(count) )
+        length <<= 1;
+
+      return length;
+    }
+
+    template <class T>
+    static  auto  Load( const char* src ) -> T
+    {
+      T   value;
+      return memcpy( &value, src, sizeof(value) ), value;
+    }
+
+    static  auto  LoadOffset( const char* tab, uint32_t len, uint32_t pos ) -> uint64_t
+    {
+      return len == sizeof(uint32_t) ? Load<uint32_t>( tab + pos * sizeof(uint32_t) ) :
+        Load<uint64_t>( tab + pos * sizeof(uint64_t) );
+    }
+
+   /*
+    * GetFooter( image, footer )
+    *
+    * Checks the signature and the consistency of the image sizes; returns false for
+    * images serialized without the navigation tail.
+    */
+    static  bool  GetFooter( const std::string_view&, Footer& );
+
+  protected:
+    static  constexpr const char signature[8] = { 'e', 'n', 't', 'i', 't', 'y', 0x01, 0x00 };
+
+  };
+
+  class EntitiesImage::Builder
+  {
+  public:
+   /*
+    * Add( reclen, id, index )
+    *
+    * Registers the next serialized record; only valid entities are hashed.
+    */
+    void  Add( size_t reclen, const std::string_view& id, uint32_t index )
+    {
+      if ( index != 0 && index != uint32_t(-1) )
+        hashed.push_back( { uint32_t(offset.size()), HashOf( id ) } );
+      offset.push_back( length );
+        length += reclen;
+    }
+
+    template <class O>
+    O*  Serialize( O* ) const;
+
+  protected:
+    struct Hashed
+    {
+      uint32_t  index;
+      uint64_t  hvalue;
+    };
+
+    std::vector<uint64_t> offset;
+    std::vector<Hashed>   hashed;
+    uint64_t              length = 0;
+
+  };
+
+  // EntitiesImage implementation
+
+  inline
+  bool  EntitiesImage::GetFooter( const std::string_view& image, Footer& footer )
+  {
+    auto  ptrtop = (const char*)nullptr;
+
+    if ( image.size() < footer_size )
+      return false;
+
+    if ( memcmp( ptrtop = image.data() + image.size() - footer_size, signature, sizeof(signature) ) != 0 )
+      return false;
+
+    footer.recordsLen = Load<uint64_t>( ptrtop + 8 );
+    footer.count      = Load<uint32_t>( ptrtop + 16 );
+    footer.hashLen    = Load<uint32_t>( ptrtop + 20 );
+    footer.offsetLen  = Load<uint32_t>( ptrtop + 24 );
+
+    if ( footer.offsetLen != sizeof(uint32_t) && footer.offsetLen != sizeof(uint64_t) )
+      return false;
+
+    return footer.recordsLen + uint64_t(footer.count) * footer.offsetLen
+      + uint64_t(footer.hashLen) * sizeof(uint32_t) + footer_size == image.size();
+  }
+
+  // EntitiesImage::Builder implementation
+
+  template <class O>
+  O*  EntitiesImage::Builder::Serialize( O* o ) const
+  {
+    auto      hashes = std::vector<uint32_t>( HashLen( uint32_t(hashed.size()) ) );
+    auto      offlen = uint32_t(length > uint32_t(-1) ? sizeof(uint64_t) : sizeof(uint32_t));
+    char      footer[footer_size] = {};
+    uint32_t  nvalue;
+
+  // store the offsets
+    if ( offlen == sizeof(uint64_t) )
+    {
+      o = ::Serialize( o, offset.data(), offset.size() * sizeof(uint64_t) );
+    }
+      else
+    {
+      auto  shrink = std::vector<uint32_t>( offset.begin(), offset.end() );
+
+      o = ::Serialize( o, shrink.data(), shrink.size() * sizeof(uint32_t) );
+    }
+
+  // fill && store the hash table
+    for ( auto& next: hashed )
+    {
+      auto  hindex = size_t(next.hvalue & (hashes.size() - 1));
+
+      while ( hashes[hindex] != 0 )
+        hindex = (hindex + 1) & (hashes.size() - 1);
+
+      hashes[hindex] = next.index;
+    }
+
+    o = ::Serialize( o, hashes.data(), hashes.size() * sizeof(uint32_t) );
+
+  // store the footer
+    memcpy( footer, signature, sizeof(signature) );
+    memcpy( footer + 8, &length, sizeof(length) );
+    memcpy( footer + 16, &(nvalue = uint32_t(offset.size())), sizeof(nvalue) );
+    memcpy( footer + 20, &(nvalue = uint32_t(hashes.size())), sizeof(nvalue) );
+    memcpy( footer + 24, &offlen, sizeof(offlen) );
+
+    return ::Serialize( o, footer, sizeof(footer) );
+  }
+
+}}
+
+# endif   // !__structo_src_indexer_entities_image_hpp__
@@ -109,21 +109,40 @@ namespace indexer {
 
   auto  IndexLayers::getKeyBlock( const std::string_view& key, const mtc::Iface* pix ) const -> mtc::api<IContentsIndex::IEntities>
   {
-    mtc::api<Entities>  entities;
+    mtc::api<Entities>    entities;
+    std::vector<uint32_t> stables;
+    uint64_t              gen_id = 0;
+    bool                  cached = keysCache != nullptr && keysCache->Get( key, gen_id, stables );
+    auto                  pcache = stables.begin();
 
     for ( auto& next: layers )
     {
-     auto  pblock = next.pIndex->GetKeyBlock( key );
+      auto  layerId = uint32_t(&next - layers.data());
+      auto  pblock = mtc::api<IContentsIndex::IEntities>();
 
-      if ( pblock != nullptr )
+    // skip the unmodified layers known to have no such key
+      if ( cached && next.dwSets == 0 )
+      {
+        if ( pcache == stables.end() || *pcache != layerId )
+          continue;
+        ++pcache;
+      }
+
+      if ( (pblock = next.pIndex->GetKeyBlock( key )) != nullptr )
       {
         if ( entities == nullptr )
           entities = new Entities( pix );
 
         entities->AddBlock( { next.uLower, next.uUpper, pblock } );
+
+        if ( !cached && next.dwSets == 0 )
+          stables.push_back( layerId );
       }
     }
 
+    if ( keysCache != nullptr && !cached )
+      keysCache->Put( key, gen_id, std::move( stables ) );
+
   // check if blocks layers has only one block
     if ( entities == nullptr || entities->Size() != 1 )
       return entities.ptr();
@@ -161,6 +180,7 @@ namespace indexer {
     auto  uLower = layers.empty() ? 1 : layers.back().uUpper + 1;
 
     layers.emplace_back( uLower, ix );
+      layersChanged();
   }
 
   auto  IndexLayers::listContents( const std::string_view& key, const mtc::Iface* poo  ) -> mtc::api<IContentsIndex::IContentsList>
@@ -189,6 +209,57 @@ namespace indexer {
     }
   }
 
+  void  IndexLayers::useKeysCache()
+  {
+    if ( keysCache == nullptr )
+      keysCache = std::make_shared<KeysCache>();
+  }
+
+  void  IndexLayers::layersChanged()
+  {
+    if ( keysCache != nullptr )
+      keysCache->Invalidate();
+  }
+
+  // IndexLayers::KeysCache implementation
+
+ /*
+  * Get( key, generation, layers )
+  *
+  * Returns true and the layers list for the actual cache entry; else returns false
+  * and the current generation to Put() the fan-out result with.
+  */
+  bool  IndexLayers::KeysCache::Get( const std::string_view& key, uint64_t& gen_id, std::vector<uint32_t>& layerIds )
+  {
+    auto  exlock = std::unique_lock<std::mutex>( cacheLock );
+    auto  pfound = cacheKeys.find( std::string( key ) );
+
+    if ( pfound == cacheKeys.end() || pfound->second.generation != generation )
+      return gen_id = generation, false;
+
+    return layerIds = pfound->second.layers, true;
+  }
+
+  void  IndexLayers::KeysCache::Put( const std::string_view& key, uint64_t gen_id, std::vector<uint32_t>&& layerIds )
+  {
+    auto  exlock = std::unique_lock<std::mutex>( cacheLock );
+
+    if ( gen_id != generation )
+      return;
+
+    if ( cacheKeys.size() >= max_keys )
+      cacheKeys.clear();
+
+    cacheKeys[std::string( key )] = { gen_id, std::move( layerIds ) };
+  }
+
+  void  IndexLayers::KeysCache::Invalidate()
+  {
+    auto  exlock = std::unique_lock<std::mutex>( cacheLock );
+
+    ++generation;
+  }
+
   // IndexLayers::IndexEntry implementation
 
   IndexLayers::IndexEntry::IndexEntry( uint32_t lower, mtc::api<IContentsIndex> index ):
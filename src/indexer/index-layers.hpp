@@ -4,6 +4,9 @@
 
 # include "../../contents.hpp"
 # include "dynamic-bitmap.hpp"
+# include <unordered_map>
+# include <memory>
+# include <mutex>
 
 namespace structo {
 namespace indexer {
@@ -24,6 +27,7 @@ namespace indexer {
   class IndexLayers
   {
     class Entities;
+    class KeysCache;
 
   public:
     IndexLayers() = default;
@@ -48,6 +52,16 @@ namespace indexer {
 
     void  hideClashes();
 
+   /*
+    * useKeysCache()
+    *
+    * Enables caching of the layers having the key block for the layers with dwSets == 0,
+    * that are not modified any more. Layers owner has to call layersChanged() on any
+    * change of the layers list, ordering or numbering.
+    */
+    void  useKeysCache();
+    void  layersChanged();
+
   protected:
     struct IndexEntry
     {
@@ -70,7 +84,40 @@ namespace indexer {
     class ContentsList;
 
   protected:
-    std::vector<IndexEntry> layers;
+    std::vector<IndexEntry>     layers;
+    std::shared_ptr<KeysCache>  keysCache;
+
+  };
+
+ /*
+  * IndexLayers::KeysCache
+  *
+  * Помнит для ключа позиции неизменяемых слоёв, в которых есть блок ключа; остальные
+  * неизменяемые слои при повторных запросах не опрашиваются. Записи помечены поколением
+  * списка слоёв и устаревают при ротации и слиянии слоёв.
+  */
+  class IndexLayers::KeysCache
+  {
+    enum: size_t
+    {
+      max_keys = 0x10000
+    };
+
+    struct CacheEntry
+    {
+      uint64_t              generation;
+      std::vector<uint32_t> layers;
+    };
+
+  public:
+    bool  Get( const std::string_view&, uint64_t&, std::vector<uint32_t>& );
+    void  Put( const std::string_view&, uint64_t, std::vector<uint32_t>&& );
+    void  Invalidate();
+
+  protected:
+    std::mutex                                  cacheLock;
+    std::unordered_map<std::string, CacheEntry> cacheKeys;
+    uint64_t                                    generation = 0;
 
   };
 
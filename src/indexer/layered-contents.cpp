@@ -139,6 +139,9 @@ namespace layered {
     auto  sources = istore->ListIndices();
     auto  dynamic = istore->CreateStore();
 
+  // the static layers are immutable; cache the layers having the keys
+    useKeysCache();
+
   // check if has any sources
     if ( sources != nullptr )
       for ( auto serial = sources->Get(); serial != nullptr; serial = sources->Get() )
@@ -255,6 +258,7 @@ namespace layered {
             .Set( istore->CreateStore() ).Create() );
           layers.back().uUpper = (uint32_t)-1;
           layers.back().dwSets = 1;
+            layersChanged();
         }
       }
     }
@@ -381,6 +385,8 @@ namespace layered {
           default:
             break;
         }
+
+        layersChanged();
       }
 
     // try select indices to be merged
@@ -419,6 +425,7 @@ namespace layered {
             limits.first->dwSets = 1;
 
             layers.erase( limits.first + 1, limits.second );
+              layersChanged();
 
             ++mergers;
           }
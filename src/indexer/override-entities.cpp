@@ -5,6 +5,8 @@ namespace indexer {
 
   class override_index final: public IEntity
   {
+    friend class Override::Entity;
+
     mtc::api<const IEntity> entity;
     uint32_t                oindex;
 
@@ -29,6 +31,8 @@ namespace indexer {
 
   class override_attributes final: public IEntity
   {
+    friend class Override::Entity;
+
     mtc::api<const IEntity>           entity;
     mtc::api<const mtc::IByteBuffer>  aprops;
 
@@ -53,6 +57,8 @@ namespace indexer {
 
   class override_bundle final: public IEntity
   {
+    friend class Override::Entity;
+
     mtc::api<const IEntity>           entity;
     mtc::api<IStorage::IBundleRepo>    istore;
     int64_t                           getpos;
@@ -94,6 +100,25 @@ namespace indexer {
     return ds != nullptr && dp != -1 ? new override_bundle( entity, ds, dp ) : entity;
   }
 
+  auto  Override::Entity::GetBundleRef() const -> std::pair<mtc::api<IStorage::IBundleRepo>, int64_t>
+  {
+    for ( auto pentity = entity.ptr(); pentity != nullptr; )
+    {
+      if ( auto pbundle = dynamic_cast<const override_bundle*>( pentity ) )
+        return { pbundle->istore, pbundle->getpos };
+
+    // the index and the attributes overrides keep the bundle of the original entity
+      if ( auto pindex = dynamic_cast<const override_index*>( pentity ) )
+        pentity = pindex->entity.ptr();
+      else
+      if ( auto pattrs = dynamic_cast<const override_attributes*>( pentity ) )
+        pentity = pattrs->entity.ptr();
+      else
+        break;
+    }
+    return { nullptr, -1 };
+  }
+
   // Override::Entities implementation
 
   Override::Entities::Entities( mtc::api<IEntities> ients, const Bitmap<>* stash, const Iface* owner ):
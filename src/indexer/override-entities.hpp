@@ -2,6 +2,7 @@
 # define __structo_src_indexer_override_entities_hxx__
 # include "../../contents.hpp"
 # include "dynamic-bitmap.hpp"
+# include <utility>
 
 namespace structo {
 namespace indexer {
@@ -22,6 +23,14 @@ namespace indexer {
     auto  Index( uint32_t ) -> mtc::api<const IEntity>;
     auto  Extra( const mtc::api<const mtc::IByteBuffer>& ) -> mtc::api<const IEntity>;
     auto  Bundle( const mtc::api<IStorage::IBundleRepo>&, int64_t ) -> mtc::api<const IEntity>;
+
+   /*
+    * GetBundleRef()
+    *
+    * Returns the repository and the position of the stored entity bundle, or { nullptr, -1 }
+    * if the bundle is not stored in a repository.
+    */
+    auto  GetBundleRef() const -> std::pair<mtc::api<IStorage::IBundleRepo>, int64_t>;
   };
 
   class Override::Entities final: public IContentsIndex::IEntities
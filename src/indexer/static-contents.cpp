@@ -4,8 +4,12 @@
 # include "dynamic-bitmap.hpp"
 # include "patch-table.hpp"
 # include "strmatch.hpp"
+# include "../queries/decompressor.hpp"
 # include <mtc/radix-tree.hpp>
 # include <mtc/arena.hpp>
+# include <unordered_map>
+# include <mutex>
+# include <list>
 
 namespace structo {
 namespace indexer {
@@ -21,6 +25,17 @@ namespace static_ {
     using ContentsTable = mtc::radix::dump<const char>;
     using ContentsIterator = ContentsTable::const_iterator;
 
+    struct DocDowel
+    {
+      uint32_t  lastId;
+      uint64_t  offset;
+    };
+    struct DocIndex final: std::vector<DocDowel>, Iface
+    {
+      implement_lifetime_control
+    };
+
+    class DowelCache;
     class EntitiesBase;
     class EntitiesLite;
     class EntitiesRich;
@@ -60,6 +75,34 @@ namespace static_ {
   protected:
     bool  delEntity( EntityId, uint32_t );
 
+  protected:
+   /*
+    * DowelCache
+    *
+    * Ограниченный LRU-кэш распакованных навигационных массивов блоков, чтобы частые
+    * термины не распаковывали навигацию при каждом запросе.
+    */
+    class DowelCache
+    {
+      enum: size_t
+      {
+        max_blocks = 0x400,       // cached navigation arrays
+        max_dowels = 0x100000     // total cached navigation points
+      };
+
+      using CacheList = std::list<std::pair<uint64_t, mtc::api<DocIndex>>>;
+
+    public:
+      auto  Get( IBlocksRepo*, uint64_t, uint32_t ) -> mtc::api<DocIndex>;
+
+    protected:
+      std::mutex                                      cacheLock;
+      CacheList                                       cacheList;    // most recently used first
+      std::unordered_map<uint64_t, CacheList::iterator> cacheKeys;
+      size_t                                          numDowels = 0;
+
+    };
+
   protected:
     mtc::Arena                  memArena;       // allocation arena
     mtc::api<ISerialized>       xStorage;       // serialized object storage holder
@@ -70,25 +113,16 @@ namespace static_ {
     mtc::api<IBlocksRepo>       blockBox;
     PatchHolder                 patchTab;
     Bitmap<Allocator>           shadowed;       // deleted documents identifiers
+    mutable DowelCache          dowelSet;       // navigation of recently used blocks
 
   };
 
   class ContentsIndex::EntitiesBase: public IEntities
   {
-    struct DocDowel
-    {
-      uint32_t  lastId;
-      uint64_t  offset;
-    };
-    struct DocIndex final: std::vector<DocDowel>, Iface
-    {
-      implement_lifetime_control
-    };
-
   public:
     EntitiesBase(
       mtc::api<const mtc::IByteBuffer>  coords,
-      mtc::api<const mtc::IByteBuffer>  dowels,
+      mtc::api<DocIndex>                dowels,
       uint32_t                          bktype,
       uint32_t                          ucount, const ContentsIndex* );
     EntitiesBase( const EntitiesBase&, const Bounds& );
@@ -126,6 +160,10 @@ namespace static_ {
     auto  Copy( const Bounds& ) const -> mtc::api<IEntities> override;
 
     implement_lifetime_control
+
+  protected:
+    queries::BulkFetcher  fetcher{ ptrtop, finish };  // bulk delta decoder
+
   };
 
   class ContentsIndex::EntitiesRich final: public EntitiesBase
@@ -295,7 +333,7 @@ namespace static_ {
         blockNavi ) != nullptr )
       {
         auto  pblock = blockBox->Get( blockOffs, blockSize );
-        auto  dowels = blockNavi != 0 ? blockBox->Get( blockOffs + blockSize, blockNavi ) : nullptr;
+        auto  dowels = blockNavi != 0 ? dowelSet.Get( blockBox.ptr(), blockOffs + blockSize, blockNavi ) : nullptr;
 
         return blockType == 0 ?
           mtc::api<IEntities>( new EntitiesLite( pblock, dowels, blockType, nEntities, this ) ) :
@@ -351,11 +389,71 @@ namespace static_ {
     return true;
   }
 
+  // ContentsIndex::DowelCache implementation
+
+  auto  ContentsIndex::DowelCache::Get( IBlocksRepo* blocks, uint64_t offset, uint32_t length ) -> mtc::api<DocIndex>
+  {
+    auto  pindex = mtc::api<DocIndex>();
+
+  // check if navigation is already cached
+    {
+      auto  exlock = std::unique_lock<std::mutex>( cacheLock );
+      auto  pfound = cacheKeys.find( offset );
+
+      if ( pfound != cacheKeys.end() )
+      {
+        cacheList.splice( cacheList.begin(), cacheList, pfound->second );
+        return pfound->second->second;
+      }
+    }
+
+  // unpack navigation points out of the lock
+    {
+      auto  navbuf = blocks->Get( offset, length );
+      auto  navbeg = navbuf->GetPtr();
+      auto  navend = navbuf->GetLen() + navbeg;
+      auto  dowel = DocDowel{ 0, 0 };
+
+      for ( pindex = new DocIndex(); navbeg < navend; )
+      {
+        uint32_t  addDoc;
+        uint64_t  addPos;
+
+        navbeg = ::FetchFrom( ::FetchFrom( navbeg, addDoc ), addPos );
+          dowel.lastId += addDoc;
+          dowel.offset += addPos;
+        pindex->emplace_back( dowel );
+      }
+    }
+
+  // register the navigation unless the other thread did it, drop least recently used
+    {
+      auto  exlock = std::unique_lock<std::mutex>( cacheLock );
+      auto  insert = cacheKeys.emplace( offset, cacheList.end() );
+
+      if ( !insert.second )
+        return insert.first->second->second;
+
+      cacheList.emplace_front( offset, pindex );
+        insert.first->second = cacheList.begin();
+      numDowels += pindex->size();
+
+      while ( cacheList.size() > 1 && (cacheList.size() > max_blocks || numDowels > max_dowels) )
+      {
+        numDowels -= cacheList.back().second->size();
+        cacheKeys.erase( cacheList.back().first );
+        cacheList.pop_back();
+      }
+    }
+
+    return pindex;
+  }
+
   // ContentsIndex::EntitiesBase implementation
 
   ContentsIndex::EntitiesBase::EntitiesBase(
     mtc::api<const mtc::IByteBuffer>  src,
-    mtc::api<const mtc::IByteBuffer>  nav,
+    mtc::api<DocIndex>                nav,
     uint32_t                          typ,
     uint32_t                          cnt,
     const ContentsIndex*              own ):
@@ -366,24 +464,11 @@ namespace static_ {
       iblock( src ),
       origin( src->GetPtr() ),
       finish( src->GetLen() + origin ),
-      ptrtop( origin )
+      ptrtop( origin ),
+      pindex( nav )
   {
-    if ( nav != nullptr )
+    if ( pindex != nullptr )
     {
-      auto  beg = nav->GetPtr();
-      auto  end = nav->GetLen() + beg;
-      auto  old = DocDowel{ 0, 0 };
-
-      for ( pindex = new DocIndex(); beg < end; )
-      {
-        uint32_t  addDoc;
-        uint64_t  addPos;
-
-        beg = ::FetchFrom( ::FetchFrom( beg, addDoc ), addPos );
-          old.lastId += addDoc;
-          old.offset += addPos;
-        pindex->emplace_back( old );
-      }
       dowBeg = pindex->data();
       dowEnd = pindex->data() + pindex->size();
     }
@@ -444,18 +529,11 @@ namespace static_ {
     if ( curref.uEntity >= tofind )
       return curref;
 
-    while ( ptrtop < finish )
+    for ( unsigned udelta; fetcher.Get( udelta ); )
     {
-      unsigned  udelta;
-
-      if ( (ptrtop = ::FetchFrom( ptrtop, udelta )) == nullptr )
-        break;
-
       if ( (curref.uEntity += udelta + 1) >= limits.uUpper )
         break;
 
-      assert( ptrtop <= finish );
-
       if ( curref.uEntity >= tofind && !parent->shadowed.Get( curref.uEntity ) )
         return curref;
     }
@@ -492,7 +570,7 @@ namespace static_ {
       unsigned  udelta;
       unsigned  ublock;
 
-      if ( (ptrtop = ::FetchFrom( ::FetchFrom( ptrtop, udelta ), ublock )) > finish )
+      if ( (ptrtop = queries::Fetch( queries::Fetch( ptrtop, udelta ), ublock )) > finish )
         break;
 
       if ( (curref.uEntity += udelta + 1) >= limits.uUpper )
@@ -523,7 +601,7 @@ namespace static_ {
       if ( !contents->shadowed.Get( ent->GetIndex() ) )
       {
         auto  patched = contents->patchTab.Search( ent->GetIndex() );
-        auto  bundled = Override::Entity( ent ).Bundle( contents->xStorage->Packages(), ent->GetPackPos() );
+        auto  bundled = Override::Entity( ent.ptr() ).Bundle( contents->xStorage->Packages(), ent->GetPackPos() );
 
         return patched != nullptr ? Override::Entity( bundled ).Extra( patched ) : bundled;
       }
@@ -537,7 +615,7 @@ namespace static_ {
       if ( !contents->shadowed.Get( ent->GetIndex() ) )
       {
         auto  patched = contents->patchTab.Search( ent->GetIndex() );
-        auto  bundled = Override::Entity( ent ).Bundle( contents->xStorage->Packages(), ent->GetPackPos() );
+        auto  bundled = Override::Entity( ent.ptr() ).Bundle( contents->xStorage->Packages(), ent->GetPackPos() );
 
         return patched != nullptr ? Override::Entity( bundled ).Extra( patched ) : bundled;
       }
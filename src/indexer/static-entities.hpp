@@ -1,8 +1,8 @@
 # if !defined( __structo_src_indexer_static_entities_hxx__ )
 # define __structo_src_indexer_static_entities_hxx__
 # include "../../contents.hpp"
-# include "../../primes.hpp"
 # include "../../compat.hpp"
+# include "entities-image.hpp"
 # include <mtc/ptrpatch.h>
 # include <stdexcept>
 # include <algorithm>
@@ -41,11 +41,11 @@ namespace static_ {
       mtc::api<const mtc::Iface>  iOwner;
     };
 
-    class Entity: public IEntity
+    class Entity final: public IEntity
     {
       friend class EntityTable;
 
-      using string = std::basic_string<char, std::char_traits<char>, Allocator>;
+      implement_lifetime_control
 
     public:
       Entity( mtc::Iface* owner, IStorage::IBundleRepo* dumps ):
@@ -53,18 +53,13 @@ namespace static_ {
         dumpStore( dumps ){}
 
     public:
-      long  Attach() override
-        {  return owner_ptr != nullptr ? owner_ptr->Attach() : 1;  }
-      long  Detach() override
-        {  return owner_ptr != nullptr ? owner_ptr->Detach() : 0;  }
-
     // overridables from IEntity
       auto  GetId() const -> EntityId override
-        {  return { entity_id, owner_ptr };  }
+        {  return { entity_id, this };  }
       auto  GetIndex() const -> uint32_t override
         {  return index;  }
       auto  GetExtra() const -> mtc::api<const mtc::IByteBuffer> override
-        {  return new Region( extras.data(), extras.size(), owner_ptr );  }
+        {  return new Region( extras.data(), extras.size(), this );  }
       auto  GetBundle() const -> mtc::api<const mtc::IByteBuffer> override
         {  return packPos != -1 && dumpStore != nullptr ? dumpStore->Get( packPos ) : nullptr;  }
       auto  GetVersion() const -> uint64_t override
@@ -82,8 +77,7 @@ namespace static_ {
       auto  FetchFrom( const char* ) -> const char*;
 
     public:
-      Iface*                owner_ptr = nullptr;
-      Entity*               collision = nullptr;
+      mtc::api<mtc::Iface>  owner_ptr;            // keeps the serialized image
       IStorage::IBundleRepo* dumpStore = nullptr;
 
       std::string_view      entity_id;
@@ -96,15 +90,18 @@ namespace static_ {
 
     class Iterator;
 
-  protected:
-    using vector_type = std::vector<Entity, AllocatorCast<Allocator, Entity>>;
-    using hash_vector = std::vector<Entity*, AllocatorCast<Allocator, Entity*>>;
-
   public:
+   /*
+    * EntityTable( image, owner, dumps )
+    *
+    * Images serialized with EntitiesImage tail are used as is, without any parsing:
+    * entities are decoded from the records on request. For older images the record
+    * offsets and the hash table are built in memory.
+    */
     EntityTable( const std::string_view&, mtc::Iface*, IStorage::IBundleRepo*, Allocator = Allocator() );
    ~EntityTable();
 
-    auto  GetEntityCount() const -> uint32_t {  return std::max( 1U, uint32_t( entityTable.size() ) ) - 1;  };
+    auto  GetEntityCount() const -> uint32_t {  return std::max( 1U, entityCount ) - 1;  };
 
   // entities access
     auto  GetEntity( uint32_t id ) const -> mtc::api<const Entity>;
@@ -115,6 +112,11 @@ namespace static_ {
     auto  GetIterator( const std::string_view& ) const -> Iterator;
 
   protected:
+    auto  getRecord( uint32_t id ) const -> const char*
+      {  return recordSet + EntitiesImage::LoadOffset( offsetTab, offsetLen, id );  }
+    auto  getEntityId( uint32_t ) const -> std::string_view;
+    bool  isValidIndex( uint32_t ) const;
+
     auto  getKeyIndex() const -> const EntityTable&;
     auto  getNextByIx( uint32_t id ) const -> uint32_t;
     auto  getNextById( uint32_t id ) const -> uint32_t;
@@ -122,10 +124,19 @@ namespace static_ {
   protected:
     using IndexByKeys = std::vector<uint32_t,
       AllocatorCast<Allocator, uint32_t>>;
+    using OffsetsTab = std::vector<uint64_t,
+      AllocatorCast<Allocator, uint64_t>>;
 
     mtc::Iface*                             contentsPtr = nullptr;
-    vector_type                             entityTable;
-    hash_vector                             entitiesMap;
+    IStorage::IBundleRepo*                  bundleRepo = nullptr;
+    const char*                             recordSet = nullptr;    // serialized entities
+    const char*                             offsetTab = nullptr;    // record offsets
+    const char*                             hashTable = nullptr;    // uint32_t entity indices, 0 - empty
+    uint32_t                                offsetLen = 0;
+    uint32_t                                entityCount = 0;
+    uint32_t                                hashLength = 0;
+    OffsetsTab                              offsetBuf;              // navigation for images without the tail
+    IndexByKeys                             hashBuffer;
     mutable std::atomic<IndexByKeys*>       indexByKeys = nullptr;
 
   };
@@ -137,23 +148,25 @@ namespace static_ {
 
     using FnNext = uint32_t  (EntityTable::*)( uint32_t ) const;
 
-    const EntityTable&  parent;
-    FnNext              fnNext;
-    uint32_t            uindex;
+    const EntityTable&      parent;
+    FnNext                  fnNext;
+    uint32_t                uindex;
+    mtc::api<const Entity>  entity;
 
   protected:
     Iterator( const EntityTable& table, FnNext fnext, uint32_t index ):
       parent( table ),
       fnNext( fnext ),
-      uindex( index ) {}
+      uindex( index ),
+      entity( table.GetEntity( index ) ) {}
 
   public:     // construction
     Iterator( const Iterator& ) = default;
     Iterator& operator=( const Iterator& ) = default;
 
   public:     // iterator properties
-    auto  Curr() -> const Entity*;
-    auto  Next() -> const Entity*;
+    auto  Curr() -> mtc::api<const Entity>;
+    auto  Next() -> mtc::api<const Entity>;
 
   };
 
@@ -183,29 +196,52 @@ namespace static_ {
   template <class Allocator>
   EntityTable<Allocator>::EntityTable( const std::string_view& input, mtc::Iface* owner, IStorage::IBundleRepo* dumps, Allocator alloc ):
     contentsPtr( owner ),
-    entityTable( alloc ),
-    entitiesMap( alloc )
+    bundleRepo( dumps ),
+    recordSet( input.data() ),
+    offsetBuf( alloc ),
+    hashBuffer( alloc )
   {
-    entityTable.reserve( input.size() / 0x40 );
+    EntitiesImage::Footer footer;
+
+  // check if the navigation tail is present and use the image as is
+    if ( EntitiesImage::GetFooter( input, footer ) )
+    {
+      offsetTab = recordSet + footer.recordsLen;
+      hashTable = offsetTab + size_t(footer.count) * footer.offsetLen;
+      offsetLen = footer.offsetLen;
+      entityCount = footer.count;
+      hashLength = footer.hashLen;
+      return;
+    }
+
+  // list the records of older image
+    offsetBuf.reserve( input.size() / 0x40 );
 
-  // load the table
     for ( auto src = input.data(), end = input.data() + input.size(); src != nullptr && src != end; )
     {
-      entityTable.emplace_back( owner, dumps );
-      src = entityTable.back().FetchFrom( src );
+      auto  recpos = src - input.data();
+
+      if ( (src = Entity( nullptr, nullptr ).FetchFrom( src )) != nullptr )
+        offsetBuf.push_back( recpos );
     }
 
-  // allocate hash table
-    entitiesMap.resize( UpperPrime( entityTable.size() ) );
+    offsetTab = (const char*)offsetBuf.data();
+    offsetLen = sizeof(uint64_t);
+    entityCount = uint32_t(offsetBuf.size());
 
-    for ( auto& next: entityTable )
-      if ( next.index != 0 && next.index != uint32_t(-1) )
+  // allocate && fill the hash table
+    hashBuffer.resize( hashLength = EntitiesImage::HashLen( entityCount ) );
+    hashTable = (const char*)hashBuffer.data();
+
+    for ( uint32_t index = 1; index < entityCount; ++index )
+      if ( isValidIndex( index ) )
       {
-        auto  hash = std::hash<std::string_view>{}( { next.entity_id.data(), next.entity_id.size() } );
-        auto  offs = hash % entitiesMap.size();
+        auto  hindex = EntitiesImage::HashOf( getEntityId( index ) ) & (hashLength - 1);
+
+        while ( hashBuffer[hindex] != 0 )
+          hindex = (hindex + 1) & (hashLength - 1);
 
-        next.collision = entitiesMap[offs];
-        entitiesMap[offs] = &next;
+        hashBuffer[hindex] = index;
       }
   }
 
@@ -220,7 +256,7 @@ namespace static_ {
     if ( pindex != nullptr )
     {
       auto  malloc = AllocatorCast<Allocator, IndexByKeys>(
-        entityTable.get_allocator() );
+        hashBuffer.get_allocator() );
 
       pindex->~IndexByKeys();
       malloc.deallocate( pindex, 0 );
@@ -230,7 +266,14 @@ namespace static_ {
   template <class Allocator>
   auto  EntityTable<Allocator>::GetEntity( uint32_t id ) const -> mtc::api<const Entity>
   {
-    return id > 0 && id < entityTable.size() ? &entityTable[id] : nullptr;
+    if ( id > 0 && id < entityCount )
+    {
+      auto  entity = mtc::api<Entity>( new Entity( contentsPtr, bundleRepo ) );
+
+      if ( entity->FetchFrom( getRecord( id ) ) != nullptr )
+        return entity.ptr();
+    }
+    return nullptr;
   }
 
   template <class Allocator>
@@ -239,14 +282,19 @@ namespace static_ {
     if ( id.empty() )
       throw std::invalid_argument( "empty entity id" );
 
-    if ( entitiesMap.size() != 0 )
+    if ( hashLength != 0 )
     {
-      auto  hash = std::hash<std::string_view>{}( { id.data(), id.size() } );
-      auto  offs = hash % entitiesMap.size();
+      auto  hindex = uint32_t(EntitiesImage::HashOf( id ) & (hashLength - 1));
 
-      for ( auto next = entitiesMap[offs]; next != nullptr; next = next->collision )
-        if ( next->entity_id == id )
-          return next;
+      for ( uint32_t nprobe = 0; nprobe != hashLength; ++nprobe, hindex = (hindex + 1) & (hashLength - 1) )
+      {
+        auto  nindex = EntitiesImage::Load<uint32_t>( hashTable + hindex * sizeof(uint32_t) );
+
+        if ( nindex == 0 )
+          break;
+        if ( nindex < entityCount && getEntityId( nindex ) == id )
+          return GetEntity( nindex );
+      }
     }
 
     return nullptr;
@@ -255,9 +303,9 @@ namespace static_ {
   template <class Allocator>
   auto  EntityTable<Allocator>::GetIterator( uint32_t id ) const -> Iterator
   {
-    for ( ; id < entityTable.size(); ++id )
+    for ( ; id < entityCount; ++id )
     {
-      if ( entityTable[id].ValidIndex() )
+      if ( isValidIndex( id ) )
         return Iterator( *this, &EntityTable::getNextByIx, id );
     }
     return Iterator( *this, &EntityTable::getNextByIx, uint32_t(-1) );
@@ -268,15 +316,38 @@ namespace static_ {
   {
     auto  pindex = getKeyIndex().indexByKeys.load();
     auto  pfound = std::lower_bound( pindex->begin(), pindex->end(), id, [&]( uint32_t i, const std::string_view& id )
-      {  return entityTable[i].entity_id < id;  } );
+      {  return getEntityId( i ) < id;  } );
 
-    while ( pfound != pindex->end() && !entityTable[*pfound].ValidIndex() )
+    while ( pfound != pindex->end() && !isValidIndex( *pfound ) )
       ++pfound;
 
     return Iterator( *this, &EntityTable::getNextById, pfound != pindex->end() ?
       *pfound : uint32_t(-1) );
   }
 
+  template <class Allocator>
+  auto  EntityTable<Allocator>::getEntityId( uint32_t id ) const -> std::string_view
+  {
+    auto      source = getRecord( id );
+    uint32_t  uindex;
+    uint64_t  uvalue;
+    unsigned  length;
+
+    if ( (source = ::FetchFrom( ::FetchFrom( ::FetchFrom( ::FetchFrom( source,
+      uindex ), uvalue ), uvalue ), length )) == nullptr ) return {};
+
+    return { source, length };
+  }
+
+  template <class Allocator>
+  bool  EntityTable<Allocator>::isValidIndex( uint32_t id ) const
+  {
+    uint32_t  uindex;
+
+    return ::FetchFrom( getRecord( id ), uindex ) != nullptr
+      && uindex != 0 && uindex != uint32_t(-1);
+  }
+
   template <class Allocator>
   auto  EntityTable<Allocator>::getKeyIndex() const -> const EntityTable&
   {
@@ -291,22 +362,22 @@ namespace static_ {
         if ( (pindex = mtc::ptr::clean( pindex )) == nullptr )
         {
           auto  malloc = AllocatorCast<Allocator, IndexByKeys>(
-            entityTable.get_allocator() );
+            hashBuffer.get_allocator() );
 
         // allocate new table
           pindex = new( malloc.allocate( 1 ) )
             IndexByKeys( malloc );
-          pindex->reserve( entityTable.size() - 1 );
+          pindex->reserve( std::max( 1U, entityCount ) - 1 );
 
         // fill table with document indices
-          for ( auto& next: entityTable )
-            if ( next.index != 0 && next.index != uint32_t(-1) )
-              pindex->push_back( next.index );
+          for ( uint32_t index = 1; index < entityCount; ++index )
+            if ( isValidIndex( index ) )
+              pindex->push_back( index );
 
         // sort ids by entity id
           std::sort( pindex->begin(), pindex->end(), [&]( uint32_t lhs, uint32_t rhs )
           {
-            return entityTable[lhs].entity_id < entityTable[rhs].entity_id;
+            return getEntityId( lhs ) < getEntityId( rhs );
           } );
 
           return indexByKeys = pindex, *this;
@@ -319,9 +390,9 @@ namespace static_ {
   {
     if ( id != uint32_t(-1) )
     {
-      for ( ++id; id != entityTable.size() && !entityTable[id].ValidIndex(); ++id )
+      for ( ++id; id < entityCount && !isValidIndex( id ); ++id )
         (void)NULL;
-      if ( id == entityTable.size() )
+      if ( id >= entityCount )
         id = uint32_t(-1);
     }
     return id;
@@ -338,7 +409,7 @@ namespace static_ {
       if ( pfound != pindex->end() )
         ++pfound;
 
-      while ( pfound != pindex->end() && !entityTable[*pfound].ValidIndex() )
+      while ( pfound != pindex->end() && !isValidIndex( *pfound ) )
         ++pfound;
 
       if ( pfound != pindex->end() )
@@ -350,20 +421,20 @@ namespace static_ {
   // EntityTable::Iterator implementation
 
   template <class Allocator>
-  auto  EntityTable<Allocator>::Iterator::Curr() -> const Entity*
+  auto  EntityTable<Allocator>::Iterator::Curr() -> mtc::api<const Entity>
   {
-    return uindex != uint32_t(-1) ? &parent.entityTable[uindex] : nullptr;
+    return entity;
   }
 
   template <class Allocator>
-  auto  EntityTable<Allocator>::Iterator::Next() -> const Entity*
+  auto  EntityTable<Allocator>::Iterator::Next() -> mtc::api<const Entity>
   {
     if ( uindex != uint32_t(-1) )
     {
       if ( (uindex = (parent.*fnNext)( uindex )) != uint32_t(-1) )
-        return &parent.entityTable[uindex];
+        return entity = parent.GetEntity( uindex );
     }
-    return nullptr;
+    return entity = nullptr;
   }
 
 }}}
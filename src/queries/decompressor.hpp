@@ -1,6 +1,9 @@
 # if !defined( __structo_src_queries_decompressor_hpp__ )
 # define __structo_src_queries_decompressor_hpp__
 # include "../../queries.hpp"
+# if defined( __AVX2__ ) || defined( __SSE2__ )
+#   include <immintrin.h>
+# endif
 
 namespace structo {
 namespace queries {
@@ -70,24 +73,138 @@ namespace queries {
     return t = result, s;
   }
 
+ /*
+  * FetchBulk( src, end, output, maxlen )
+  *
+  * Декодирует до maxlen значений varint из [src, end), сдвигает src и возвращает
+  * количество декодированных значений.
+  * Серии однобайтовых значений (типичные дельты позиций и документов) распаковываются
+  * векторно по 16 (SSE2) или 32 (AVX2) байта за итерацию, остальные - скалярно.
+  */
+  inline size_t FetchBulk( const char*& src, const char* end, unsigned* output, size_t maxlen ) noexcept
+  {
+    auto  outPtr = output;
+    auto  outEnd = output + maxlen;
+
+# if defined( __AVX2__ )
+    while ( end - src >= 32 && outEnd - outPtr >= 32 )
+    {
+      auto  vbytes = _mm256_loadu_si256( (const __m256i*)src );
+      auto  hiBits = uint32_t(_mm256_movemask_epi8( vbytes ));
+
+      if ( hiBits == 0 )
+      {
+        auto  lovals = _mm256_castsi256_si128( vbytes );
+        auto  hivals = _mm256_extracti128_si256( vbytes, 1 );
+
+        _mm256_storeu_si256( (__m256i*)(outPtr + 0x00), _mm256_cvtepu8_epi32( lovals ) );
+        _mm256_storeu_si256( (__m256i*)(outPtr + 0x08), _mm256_cvtepu8_epi32( _mm_srli_si128( lovals, 8 ) ) );
+        _mm256_storeu_si256( (__m256i*)(outPtr + 0x10), _mm256_cvtepu8_epi32( hivals ) );
+        _mm256_storeu_si256( (__m256i*)(outPtr + 0x18), _mm256_cvtepu8_epi32( _mm_srli_si128( hivals, 8 ) ) );
+
+        src += 32;
+        outPtr += 32;
+      }
+        else
+      {
+        for ( auto nshort = __builtin_ctz( hiBits ); nshort-- > 0; )
+          *outPtr++ = uint8_t(*src++);
+        src = Fetch( src, *outPtr++ );
+      }
+    }
+# elif defined( __SSE2__ )
+    while ( end - src >= 16 && outEnd - outPtr >= 16 )
+    {
+      auto  vbytes = _mm_loadu_si128( (const __m128i*)src );
+      auto  hiBits = unsigned(_mm_movemask_epi8( vbytes ));
+
+      if ( hiBits == 0 )
+      {
+        auto  zeroes = _mm_setzero_si128();
+        auto  lo_u16 = _mm_unpacklo_epi8( vbytes, zeroes );
+        auto  hi_u16 = _mm_unpackhi_epi8( vbytes, zeroes );
+
+        _mm_storeu_si128( (__m128i*)(outPtr + 0x00), _mm_unpacklo_epi16( lo_u16, zeroes ) );
+        _mm_storeu_si128( (__m128i*)(outPtr + 0x04), _mm_unpackhi_epi16( lo_u16, zeroes ) );
+        _mm_storeu_si128( (__m128i*)(outPtr + 0x08), _mm_unpacklo_epi16( hi_u16, zeroes ) );
+        _mm_storeu_si128( (__m128i*)(outPtr + 0x0c), _mm_unpackhi_epi16( hi_u16, zeroes ) );
+
+        src += 16;
+        outPtr += 16;
+      }
+        else
+      {
+        for ( auto nshort = __builtin_ctz( hiBits ); nshort-- > 0; )
+          *outPtr++ = uint8_t(*src++);
+        src = Fetch( src, *outPtr++ );
+      }
+    }
+# endif   // __AVX2__ || __SSE2__
+
+    while ( src < end && outPtr != outEnd )
+      src = Fetch( src, *outPtr++ );
+
+    return outPtr - output;
+  }
+
+ /*
+  * BulkFetcher
+  *
+  * Буферизованный поток значений varint поверх FetchBulk() для циклов, которые
+  * потребляют значения по одному и могут прерваться в любой момент.
+  */
+  class BulkFetcher
+  {
+    enum: size_t
+    {
+      buffer_size = 0x40
+    };
+
+  public:
+    BulkFetcher( const char* beg, const char* end ):
+      srcPtr( beg ),
+      srcEnd( end ) {}
+
+    BulkFetcher( const BulkFetcher& ) = delete;
+
+    bool  Get( unsigned& value )
+    {
+      if ( bufPtr == bufEnd && !Load() )
+        return false;
+      return value = *bufPtr++, true;
+    }
+
+  protected:
+    bool  Load()
+    {
+      bufPtr = buffer;
+      bufEnd = buffer + FetchBulk( srcPtr, srcEnd, buffer, buffer_size );
+      return bufPtr != bufEnd;
+    }
+
+  protected:
+    const char* srcPtr;
+    const char* srcEnd;
+    unsigned    buffer[buffer_size];
+    unsigned*   bufPtr = buffer;
+    unsigned*   bufEnd = buffer;
+
+  };
+
   template <class MinPos, class MaxPos>
   auto  UnpackWordPos(
     unsigned* output,
     size_t    maxLen, const std::string_view& source, MinPos minpos, MaxPos maxpos ) -> size_t
   {
-    auto  srcPtr( source.data() );
-    auto  srcEnd( source.data() + source.size() );
-    auto  uEntry = unsigned(0);
-    auto  outPtr = output;
-    auto  outEnd = outPtr + maxLen;
+    auto      fetch = BulkFetcher( source.data(), source.data() + source.size() );
+    auto      uEntry = unsigned(0);
+    auto      outPtr = output;
+    auto      outEnd = outPtr + maxLen;
+    unsigned  uOrder;
 
-    for ( ; srcPtr < srcEnd && outPtr != outEnd && maxpos( uEntry ); ++uEntry )
+    for ( ; outPtr != outEnd && fetch.Get( uOrder ) && maxpos( (uEntry += uOrder) ); ++uEntry )
     {
-      unsigned  uOrder;
-
-      srcPtr = Fetch( srcPtr, uOrder );
-
-      if ( minpos( (uEntry = (uOrder += uEntry) ) ) )
+      if ( minpos( uEntry ) )
         *outPtr++ = uEntry;
     }
 
@@ -99,19 +216,15 @@ namespace queries {
     PosFid*   output,
     size_t    maxLen, const std::string_view& source, MinPos minpos, MaxPos maxpos ) -> size_t
   {
-    auto  srcPtr( source.data() );
-    auto  srcEnd( source.data() + source.size() );
-    auto  uEntry = 0U;
-    auto  outPtr = output;
-    auto  outEnd = outPtr + maxLen;
+    auto      fetch = BulkFetcher( source.data(), source.data() + source.size() );
+    auto      uEntry = 0U;
+    auto      outPtr = output;
+    auto      outEnd = outPtr + maxLen;
+    unsigned  uOrder;
 
-    for ( ; srcPtr < srcEnd && outPtr != outEnd && maxpos( uEntry ); ++uEntry )
+    for ( ; outPtr != outEnd && fetch.Get( uOrder ) && maxpos( (uEntry += uOrder) ); ++uEntry )
     {
-      unsigned  uOrder;
-
-      srcPtr = Fetch( srcPtr, uOrder );
-
-      if ( minpos( (uEntry = (uOrder += uEntry) ) ) )
+      if ( minpos( uEntry ) )
         *outPtr++ = { uEntry, 0xff };
     }
 
@@ -125,20 +238,16 @@ namespace queries {
     MinPos              minpos,
     MaxPos              maxpos, unsigned id ) -> unsigned
   {
-    auto  srcPtr( source.data() );
-    auto  srcEnd( source.data() + source.size() );
-    auto  uEntry = unsigned(0);
-    auto  outPtr = output;
-    auto  outEnd = outPtr + maxLen;
-
-    for ( ; srcPtr < srcEnd && outPtr != outEnd && maxpos( uEntry ); ++uEntry )
+    auto      fetch = BulkFetcher( source.data(), source.data() + source.size() );
+    auto      uEntry = unsigned(0);
+    auto      outPtr = output;
+    auto      outEnd = outPtr + maxLen;
+    unsigned  uOrder;
+    double    weight;
+
+    for ( ; outPtr != outEnd && fetch.Get( uOrder ) && maxpos( (uEntry += uOrder) ); ++uEntry )
     {
-      unsigned  uOrder;
-      double    weight;
-
-      srcPtr = Fetch( srcPtr, uOrder );
-
-      if ( minpos( (uEntry = (uOrder += uEntry) ) ) && (weight = ranker( uEntry, 0xff )) > 0 )
+      if ( minpos( uEntry ) && (weight = ranker( uEntry, 0xff )) > 0 )
         MakeEntrySet( *outPtr++, { uEntry, id }, weight );
     }
 
@@ -164,16 +273,15 @@ namespace queries {
       srcPtr = Fetch( Fetch( srcPtr, ctlFid ), uEntry );
       getFid = ctlFid >> 2;
 
-      for ( ; outPtr != outEnd && maxpos( uEntry ); ++uEntry )
+      for ( auto fetch = BulkFetcher( srcPtr, srcEnd ); outPtr != outEnd && maxpos( uEntry ); ++uEntry )
       {
         if ( minpos( uEntry ) )
           *outPtr++ = { uEntry, getFid };
 
-        if ( srcPtr == srcEnd )
+        if ( !fetch.Get( ctlFid ) )
           break;
 
-        srcPtr = Fetch( srcPtr, ctlFid );
-          uEntry += ctlFid;
+        uEntry += ctlFid;
       }
     }
       else
@@ -222,16 +330,15 @@ namespace queries {
       srcPtr = Fetch( Fetch( srcPtr, ctlFid ), uEntry );
         getFid = ctlFid >> 2;
 
-      for ( ; outPtr != outEnd && maxpos( uEntry ); ++uEntry )
+      for ( auto fetch = BulkFetcher( srcPtr, srcEnd ); outPtr != outEnd && maxpos( uEntry ); ++uEntry )
       {
         if ( minpos( uEntry ) && (weight = ranker( uEntry, getFid )) > 0 )
           MakeEntrySet( *outPtr++, { uEntry, id }, weight );
 
-        if ( srcPtr == srcEnd )
+        if ( !fetch.Get( ctlFid ) )
           break;
 
-        srcPtr = Fetch( srcPtr, ctlFid );
-          uEntry += ctlFid;
+        uEntry += ctlFid;
       }
     }
       else
@@ -273,34 +380,49 @@ namespace queries {
       UnpackWordPos( output, N, source, Pos::Any{}, Pos::Any{} );
   }
 
-  template <size_t N>
+  inline
   auto  UnpackWordPos(
-    PosFid  (&output)[N], const std::string_view& source, const Limits& limits ) -> unsigned
+    PosFid* output, size_t  maxlen, const std::string_view& source, const Limits& limits ) -> unsigned
   {
     if ( limits.uLower != 0 )
     {
       return limits.uUpper != (unsigned)-1 ?
-        UnpackWordPos( output, N, source, Pos::Min{ limits.uLower }, Pos::Max{ limits.uUpper } ) :
-        UnpackWordPos( output, N, source, Pos::Min{ limits.uLower }, Pos::Any{} );
+        UnpackWordPos( output, maxlen, source, Pos::Min{ limits.uLower }, Pos::Max{ limits.uUpper } ) :
+        UnpackWordPos( output, maxlen, source, Pos::Min{ limits.uLower }, Pos::Any{} );
     }
     return limits.uUpper != (unsigned)-1 ?
-      UnpackWordPos( output, N, source, Pos::Any{}, Pos::Max{ limits.uUpper } ) :
-      UnpackWordPos( output, N, source, Pos::Any{}, Pos::Any{} );
+      UnpackWordPos( output, maxlen, source, Pos::Any{}, Pos::Max{ limits.uUpper } ) :
+      UnpackWordPos( output, maxlen, source, Pos::Any{}, Pos::Any{} );
   }
 
-  template <size_t N, class RankEntry>
+  template <size_t N>
   auto  UnpackWordPos(
-    Abstract::EntrySet (&output)[N], const std::string_view& source, const RankEntry& ranker, const Limits& limits, unsigned id ) -> unsigned
+    PosFid  (&output)[N], const std::string_view& source, const Limits& limits ) -> unsigned
+  {
+    return UnpackWordPos( output, N, source, limits );
+  }
+
+  template <class RankEntry>
+  auto  UnpackWordPos(
+    Abstract::EntrySet* output,
+    size_t              maxlen, const std::string_view& source, const RankEntry& ranker, const Limits& limits, unsigned id ) -> unsigned
   {
     if ( limits.uLower != 0 )
     {
       return limits.uUpper != (unsigned)-1 ?
-        UnpackWordPos( output, N, source, ranker, Pos::Min{ limits.uLower }, Pos::Max{ limits.uUpper }, id ) :
-        UnpackWordPos( output, N, source, ranker, Pos::Min{ limits.uLower }, Pos::Any{}, id );
+        UnpackWordPos( output, maxlen, source, ranker, Pos::Min{ limits.uLower }, Pos::Max{ limits.uUpper }, id ) :
+        UnpackWordPos( output, maxlen, source, ranker, Pos::Min{ limits.uLower }, Pos::Any{}, id );
     }
     return limits.uUpper != (unsigned)-1 ?
-      UnpackWordPos( output, N, source, ranker, Pos::Any{}, Pos::Max{ limits.uUpper }, id ) :
-      UnpackWordPos( output, N, source, ranker, Pos::Any{}, Pos::Any{}, id );
+      UnpackWordPos( output, maxlen, source, ranker, Pos::Any{}, Pos::Max{ limits.uUpper }, id ) :
+      UnpackWordPos( output, maxlen, source, ranker, Pos::Any{}, Pos::Any{}, id );
+  }
+
+  template <size_t N, class RankEntry>
+  auto  UnpackWordPos(
+    Abstract::EntrySet (&output)[N], const std::string_view& source, const RankEntry& ranker, const Limits& limits, unsigned id ) -> unsigned
+  {
+    return UnpackWordPos( output, N, source, ranker, limits, id );
   }
 
   inline
@@ -0,0 +1,121 @@
+# if !defined( __structo_src_queries_entry_buffer_hpp__ )
+# define __structo_src_queries_entry_buffer_hpp__
+# include <algorithm>
+# include <utility>
+# include <vector>
+
+namespace structo {
+namespace queries {
+
+ /*
+  * EntryBuffer<T>
+  *
+  * Растущий по требованию буфер для распаковки вхождений терминов запроса.
+  *
+  * Память не выделяется до первого обращения к Reserve(), а освобождаемые буферы
+  * возвращаются в пул потока и повторно используются следующими запросами, так что
+  * запрос из многих терминов не резервирует мегабайты памяти заранее.
+  *
+  * Пул потока хранит не более pool_size буферов общим объёмом не более pool_bytes;
+  * не помещающиеся в этот объём буферы освобождаются.
+  */
+  template <class T>
+  class EntryBuffer
+  {
+    enum: size_t
+    {
+      pool_size = 0x40,         // buffers kept by the thread pool
+      pool_bytes = 0x400000     // memory kept by the thread pool
+    };
+
+    using Storage = std::vector<T>;
+
+    struct Storages
+    {
+      std::vector<Storage>  buffers;
+      size_t                nbytes = 0;
+    };
+
+  public:
+    EntryBuffer() = default;
+    EntryBuffer( EntryBuffer&& ) = default;
+    EntryBuffer( const EntryBuffer& ) = delete;
+    EntryBuffer& operator = ( const EntryBuffer& ) = delete;
+   ~EntryBuffer();
+
+  public:
+   /*
+    * Reserve( count )
+    *
+    * Provides at least count elements and returns the buffer; the previous contents
+    * are not preserved.
+    */
+    auto  Reserve( size_t ) -> T*;
+
+    auto  data() const -> T*  {  return const_cast<T*>( buffer.data() );  }
+    auto  size() const -> size_t  {  return buffer.size();  }
+
+  protected:
+    static  auto  Pool() -> Storages&
+    {
+      thread_local Storages pool;
+      return pool;
+    }
+
+  protected:
+    Storage buffer;
+
+  };
+
+  // EntryBuffer template implementation
+
+  template <class T>
+  EntryBuffer<T>::~EntryBuffer()
+  {
+    auto& pool = Pool();
+    auto  size = buffer.capacity() * sizeof(T);
+
+    if ( size != 0 && pool.buffers.size() < pool_size && pool.nbytes + size <= pool_bytes )
+    {
+      pool.buffers.push_back( std::move( buffer ) );
+      pool.nbytes += size;
+    }
+  }
+
+  template <class T>
+  auto  EntryBuffer<T>::Reserve( size_t count ) -> T*
+  {
+    if ( buffer.size() >= count )
+      return buffer.data();
+
+  // get the largest of pooled buffers instead of allocating the new one
+    if ( buffer.capacity() == 0 )
+    {
+      auto& pool = Pool();
+
+      if ( !pool.buffers.empty() )
+      {
+        auto  select = std::max_element( pool.buffers.begin(), pool.buffers.end(), []( const Storage& a, const Storage& b )
+          {  return a.capacity() < b.capacity();  } );
+
+        std::swap( *select, pool.buffers.back() );
+          buffer = std::move( pool.buffers.back() );
+        pool.buffers.pop_back();
+        pool.nbytes -= buffer.capacity() * sizeof(T);
+      }
+    }
+
+  // grow geometrically to avoid reallocations on each next larger entity
+    if ( buffer.capacity() < count )
+    {
+      buffer.clear();
+      buffer.reserve( std::max( count, 2 * buffer.capacity() ) );
+    }
+    buffer.resize( std::max( count, buffer.capacity() ) );
+
+    return buffer.data();
+  }
+
+}}
+
+# endif   // !__structo_src_queries_entry_buffer_hpp__
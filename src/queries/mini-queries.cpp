@@ -1,4 +1,5 @@
 # include "../../queries/builder.hpp"
+# include "../../rankers.hpp"
 # include "query-tools.hpp"
 # include "context/processor.hpp"
 # include <mtc/bitset.h>
@@ -14,11 +15,12 @@ namespace queries {
   * MiniQueryBase обеспечивает синхронное продвижение по форматам вместе с координатами
   * и передаёт распакованные форматы альтернативному методу доступа ко вхождениям.
   */
-  struct MiniQueryBase: IQuery
+  struct MiniQueryBase: IPrunedQuery
   {
     uint32_t            entityId = 0;                       // the found entity
     mtc::api<IEntities> docStats;                           // formats and lengths
     Abstract            abstract = {};
+    double              minWeight = 0.0;                    // top-k threshold
 
     class uninitialized_exception: public std::runtime_error
       {  using runtime_error::runtime_error;  };
@@ -36,6 +38,14 @@ namespace queries {
     {
       return BuildCopy( bounds ).ptr();
     }
+    auto  GetMinWeight() -> double override
+    {
+      return minWeight;
+    }
+    void  SetMinWeight( double weight ) override
+    {
+      minWeight = weight;
+    }
     auto  GetTuples( uint32_t udocid ) -> const Abstract& override
     {
       if ( (abstract = GetChunks( udocid )).dwMode != Abstract::None )
@@ -47,6 +57,23 @@ namespace queries {
       }
       return abstract;
     }
+   /*
+    * LengthNorm( id )
+    *
+    * Mini queries report single occurences of the terms, so the entity length limits
+    * the weight of any term; returns the share of the length-free estimate reachable
+    * by the entity id, or 0 for entities without statistics.
+    */
+    auto  LengthNorm( uint32_t udocid ) -> double
+    {
+      auto      enstat = docStats->Find( udocid );
+      unsigned  nWords = 0;
+
+      if ( enstat.uEntity == udocid ) ::FetchFrom( enstat.details.data(), nWords );
+        else return 0.0;
+
+      return nWords != 0 ? rankers::BM25Bound( 1.0, nWords ) / rankers::BM25Bound( 1.0 ) : 0.0;
+    }
     // local overridables
     virtual auto  BuildCopy( const Bounds& ) -> mtc::api<MiniQueryBase> = 0;
     virtual auto  GetChunks( uint32_t ) -> Abstract& = 0;
@@ -68,6 +95,7 @@ namespace queries {
     auto  GetChunks( uint32_t ) -> Abstract& override;
     auto  LastIndex() -> uint32_t override;
     auto  SearchDoc( uint32_t ) -> uint32_t override;
+    auto  MaxWeight() -> double override;
 
     implement_lifetime_control
 
@@ -113,6 +141,7 @@ namespace queries {
     auto  GetChunks( uint32_t ) -> Abstract& override;
     auto  LastIndex() -> uint32_t override;
     auto  SearchDoc( uint32_t ) -> uint32_t override;
+    auto  MaxWeight() -> double override;
 
     implement_lifetime_control
 
@@ -132,12 +161,17 @@ namespace queries {
   public:
     void   AddQueryNode( mtc::api<MiniQueryBase>, double );
     auto   StrictSearch( uint32_t ) -> uint32_t;
+    auto   MaxWeight() -> double override;
+
+  protected:
+    auto   MaxWeight( uint32_t ) const -> double;
 
   protected:
     struct SubQuery
     {
       mtc::api<MiniQueryBase> subQuery;
       double                  keyRange;
+      double                  maxScore;             // BM25 upper estimate
       double                  leastSum = 0.0;
       unsigned                docFound = 0;
       Abstract                abstract = {};
@@ -216,8 +250,12 @@ namespace queries {
 
     implement_lifetime_control
 
+  protected:
+    auto  PrunedSearch( uint32_t ) -> uint32_t;
+
   protected:
     std::vector<Abstract*>  selected;
+    std::vector<SubQuery*>  byWeight;     // subqueries ordered by maxScore
   };
 
   // MiniQueryBase implementation
@@ -288,6 +326,11 @@ namespace queries {
     return abstract = {}, entityId = (docRefer = entBlock->Find( tofind )).uEntity;
   }
 
+  auto  MiniQueryTerm::MaxWeight() -> double
+  {
+    return rankers::BM25Bound( bm25Term.dblIDF );
+  }
+
   // MiniMultiTerm implementation
 
   MiniMultiTerm::MiniMultiTerm( const MiniMultiTerm& multi, const Bounds& bounds ):
@@ -364,6 +407,16 @@ namespace queries {
     return abstract = {}, entityId = uFound;
   }
 
+  auto  MiniMultiTerm::MaxWeight() -> double
+  {
+    auto  maxIdf = 0.0;
+
+    for ( auto& next: blockSet )
+      maxIdf = std::max( maxIdf, next.idfValue );
+
+    return rankers::BM25Bound( maxIdf );
+  }
+
   // MiniQueryArgs implementation
 
   MiniQueryArgs::MiniQueryArgs( const MiniQueryArgs& source, const Bounds& bounds, bool exceptIfNULL ):
@@ -389,7 +442,7 @@ namespace queries {
   {
     double  rgsumm = 0.0;
 
-    querySet.push_back( { query, range } );
+    querySet.push_back( { query, range, query->MaxWeight() } );
 
     std::sort( querySet.begin(), querySet.end(), []( const SubQuery& s1, const SubQuery& s2 )
       {  return s1.keyRange > s2.keyRange; } );
@@ -401,6 +454,33 @@ namespace queries {
       next.leastSum = (rgsumm -= next.keyRange);
   }
 
+  auto  MiniQueryArgs::MaxWeight() -> double
+  {
+    auto  weight = 0.0;
+
+    for ( auto& next: querySet )
+      weight += next.maxScore;
+
+    return weight;
+  }
+
+ /*
+  * MaxWeight( id )
+  *
+  * Upper estimate of the weight for the entity id using the subqueries already
+  * positioned at this entity.
+  */
+  auto  MiniQueryArgs::MaxWeight( uint32_t id ) const -> double
+  {
+    auto  weight = 0.0;
+
+    for ( auto& next: querySet )
+      if ( next.docFound == id )
+        weight += next.maxScore;
+
+    return weight;
+  }
+
   uint32_t  MiniQueryArgs::StrictSearch( uint32_t tofind )
   {
     if ( (tofind = std::max( tofind, entityId )) == uint32_t(-1) )
@@ -550,8 +630,10 @@ namespace queries {
         } else ++nstart;
       }
 
-    // check if is found or not
-      if ( ufound == uint32_t(-1) || weight >= quorum )
+    // check if is found or not; skip entities not reaching the top-k threshold
+      if ( ufound == uint32_t(-1) )
+        return entityId = ufound;
+      if ( weight >= quorum && (minWeight <= 0.0 || MaxWeight( ufound ) * LengthNorm( ufound ) >= minWeight) )
         return entityId = ufound;
       tofind = ufound + 1;
     }
@@ -605,6 +687,9 @@ namespace queries {
     if ( entityId != tofind )
       abstract = {};
 
+    if ( minWeight > 0.0 )
+      return entityId = PrunedSearch( tofind );
+
     uFound = uint32_t(-1);
 
     for ( auto& next: querySet )
@@ -613,6 +698,68 @@ namespace queries {
     return entityId = uFound;
   }
 
+ /*
+  * MiniQueryAny::PrunedSearch( tofind )
+  *
+  * MaxScore search: the weakest subqueries whose summary upper estimate stays below
+  * the top-k threshold can not select an entity alone, so the candidates are taken
+  * only from the other ('essential') subqueries, and the weak ones are just probed
+  * for the candidates, from the strongest to the weakest, while the estimate allows.
+  *
+  * The estimate of a candidate is scaled by its length, so long entities are skipped
+  * without probing even if all the subqueries might match them.
+  */
+  auto  MiniQueryAny::PrunedSearch( uint32_t tofind ) -> uint32_t
+  {
+    auto  nonEss = size_t(0);
+    auto  nonSum = 0.0;
+
+    if ( byWeight.empty() )
+    {
+      for ( auto& next: querySet )
+        byWeight.push_back( &next );
+
+      std::sort( byWeight.begin(), byWeight.end(), []( const SubQuery* a, const SubQuery* b )
+        {  return a->maxScore < b->maxScore;  } );
+    }
+
+  // split the subqueries to non-essential and essential ones
+    while ( nonEss != byWeight.size() && nonSum + byWeight[nonEss]->maxScore < minWeight )
+      nonSum += byWeight[nonEss++]->maxScore;
+
+    if ( nonEss == byWeight.size() )
+      return uint32_t(-1);
+
+    for ( ; ; )
+    {
+      auto  uFound = uint32_t(-1);
+      auto  weight = nonSum;
+      auto  factor = 0.0;
+
+      for ( auto next = byWeight.begin() + nonEss; next != byWeight.end(); ++next )
+        uFound = std::min( uFound, (*next)->SearchDoc( tofind ) );
+
+      if ( uFound == uint32_t(-1) )
+        return uFound;
+
+      for ( auto next = byWeight.begin() + nonEss; next != byWeight.end(); ++next )
+        if ( (*next)->docFound == uFound )
+          weight += (*next)->maxScore;
+
+      if ( weight >= minWeight )
+        weight *= (factor = LengthNorm( uFound ));
+
+      for ( auto ntest = nonEss; ntest-- > 0 && weight >= minWeight; )
+        if ( byWeight[ntest]->SearchDoc( uFound ) != uFound )
+          weight -= byWeight[ntest]->maxScore * factor;
+
+      if ( weight >= minWeight )
+        return uFound;
+
+      tofind = uFound + 1;
+    }
+  }
+
   // Query creation entry
 
   class MiniBuilder
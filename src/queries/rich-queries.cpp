@@ -5,6 +5,7 @@
 # include "query-tools.hpp"
 # include "field-set.hpp"
 # include "decompressor.hpp"
+# include "entry-buffer.hpp"
 # include "context/processor.hpp"
 # include <mtc/bitset.h>
 
@@ -17,6 +18,8 @@ namespace queries {
   using IEntities = IContentsIndex::IEntities;
   using Reference = IEntities::Reference;
 
+  const size_t  maxEntries = 0x10000;   // entries unpacked per term and entity
+
  /*
   * RichQueryBase обеспечивает синхронное продвижение по форматам вместе с координатами
   * и передаёт распакованные форматы альтернативному методу доступа ко вхождениям.
@@ -73,11 +76,11 @@ namespace queries {
     implement_lifetime_control
 
   protected:
-    mtc::api<IEntities> entBlock;
-    const unsigned      datatype;
-    TermRanker          tmRanker;
-    Reference           docRefer = { 0, {} };
-    EntrySet            entryBuf[0x10000];
+    mtc::api<IEntities>   entBlock;
+    const unsigned        datatype;
+    TermRanker            tmRanker;
+    Reference             docRefer = { 0, {} };
+    EntryBuffer<EntrySet> entryBuf;
 
   };
 
@@ -94,7 +97,7 @@ namespace queries {
       const unsigned      datatype;
       TermRanker          tmRanker;
       Reference           docRefer = { 0, { nullptr, 0 } };   // entity reference set
-      PosFid              entryPos[0x10000];
+      EntryBuffer<PosFid> entryPos;
 
     // construction
       KeyBlock( const mtc::api<IEntities>& bk, const TermRanker& tr ):
@@ -105,9 +108,12 @@ namespace queries {
     // methods
       auto  Unpack( const Limits& limits ) -> unsigned
       {
+        auto  maxlen = std::min( docRefer.details.size(), maxEntries );
+        auto  outbuf = entryPos.Reserve( maxlen );
+
         return
-          datatype == 20 ? UnpackWordPos( entryPos, docRefer.details, limits ) :
-          datatype == 21 ? UnpackWordFid( entryPos, docRefer.details, limits ) :
+          datatype == 20 ? UnpackWordPos( outbuf, maxlen, docRefer.details, limits ) :
+          datatype == 21 ? UnpackWordFid( outbuf, maxlen, docRefer.details, limits ) :
           throw std::logic_error( "unknown block type @" __FILE__ ":" LINE_STRING );
       }
     };
@@ -127,7 +133,7 @@ namespace queries {
 
   protected:
     std::vector<KeyBlock>   blockSet;
-    std::vector<EntrySet>   entryBuf;
+    EntryBuffer<EntrySet>   entryBuf;
 
   };
 
@@ -164,12 +170,20 @@ namespace queries {
       }
     };
 
+   /*
+    * ReserveOutput( entries, points ) provides the output buffers for the upper estimate
+    * of the output size, but not more than maxEntries, and returns their origins.
+    */
+    auto  ReserveOutput( size_t, size_t ) -> std::pair<EntrySet*, EntryPos*>;
+
+    static  auto  MaxSpread( const Abstract& ) -> size_t;
+
   protected:
     std::vector<SubQuery> querySet;
-    std::vector<EntrySet> entryBuf;
-    std::vector<EntryPos> pointBuf;
-    const EntrySet*       entryEnd;
-    const EntryPos*       pointEnd;
+    EntryBuffer<EntrySet> entryBuf;
+    EntryBuffer<EntryPos> pointBuf;
+    const EntrySet*       entryEnd = nullptr;
+    const EntryPos*       pointEnd = nullptr;
 
   };
 
@@ -283,7 +297,7 @@ namespace queries {
   protected:
     mtc::api<RichQueryBase> subQuery;
     std::vector<unsigned>   matchSet;
-    EntrySet                entryBuf[0x10000];
+    EntryBuffer<EntrySet>   entryBuf;
 
   };
 
@@ -405,12 +419,14 @@ namespace queries {
       auto  format = context::formats::FormatBox( fmt );
       auto  ranker = [&]( unsigned pos, uint8_t fid ) -> double
         {  return tmRanker( format.Get( pos ), fid );  };
+      auto  maxlen = std::min( docRefer.details.size(), maxEntries );
+      auto  outbuf = entryBuf.Reserve( maxlen );
       auto  numEnt = datatype == 20 ?
-        UnpackWordPos( entryBuf, docRefer.details, ranker, lim, 0 ) :
-        UnpackWordFid( entryBuf, docRefer.details, ranker, lim, 0 );
+        UnpackWordPos( outbuf, maxlen, docRefer.details, ranker, lim, 0 ) :
+        UnpackWordFid( outbuf, maxlen, docRefer.details, ranker, lim, 0 );
 
       if ( numEnt != 0 )
-        abstract = { Abstract::Rich, 0, entryBuf, entryBuf + numEnt };
+        abstract = { Abstract::Rich, 0, outbuf, outbuf + numEnt };
     }
     return abstract;
   }
@@ -418,7 +434,7 @@ namespace queries {
   // RichMultiTerm implementation
 
   RichMultiTerm::RichMultiTerm( const RichMultiTerm& multi, const Bounds& bounds ):
-    RichQueryBase( multi, bounds ), entryBuf( 0x10000 )
+    RichQueryBase( multi, bounds )
   {
     for ( auto& next: multi.blockSet )
     {
@@ -432,8 +448,7 @@ namespace queries {
   }
 
   RichMultiTerm::RichMultiTerm( mtc::api<IEntities> fmt, std::vector<std::pair<mtc::api<IEntities>, TermRanker>>& terms ):
-    RichQueryBase( fmt ),
-    entryBuf( 0x10000 )
+    RichQueryBase( fmt )
   {
     for ( auto& create: terms )
       blockSet.emplace_back( create.first, create.second );
@@ -443,7 +458,7 @@ namespace queries {
   {
     auto  lastId = uint32_t(0);
 
-    for ( auto block: blockSet )
+    for ( auto& block: blockSet )
       lastId = std::max( lastId, block.entBlock->Last() );
 
     return lastId;
@@ -491,8 +506,7 @@ namespace queries {
       auto      format = context::formats::FormatBox( ftbuff );
       auto      pfound = (PosSet*)alloca( blockSet.size() * sizeof(PosSet) );
       size_t    nfound = 0;
-      auto      entPtr = entryBuf.data();
-      auto      entEnd = entryBuf.data() + entryBuf.size();
+      size_t    ntotal = 0;
       unsigned  lLimit;
       double    weight;
 
@@ -501,12 +515,18 @@ namespace queries {
       for ( auto& next: blockSet )
         if ( next.docRefer.uEntity == getdoc )
           if ( (lLimit = next.Unpack( limits )) != 0 )
-            new( pfound + nfound++ ) PosSet{ next.entryPos, next.entryPos + lLimit, next.tmRanker };
+          {
+            new( pfound + nfound++ ) PosSet{ next.entryPos.data(), next.entryPos.data() + lLimit, next.tmRanker };
+            ntotal += lLimit;
+          }
 
     // check if single or multiple blocks
       if ( nfound == 0 )
         return abstract = {};
 
+      auto  entPtr = entryBuf.Reserve( std::min( ntotal, maxEntries ) );
+      auto  entEnd = entPtr + std::min( ntotal, maxEntries );
+
     // check if only one list
       if ( nfound == 1 )
       {
@@ -558,20 +578,12 @@ namespace queries {
   // RichQueryArgs implementation
 
   RichQueryArgs::RichQueryArgs( mtc::api<IEntities> fmt ):
-    RichQueryBase( fmt ),
-    entryBuf( 0x10000 ),
-    pointBuf( 0x10000 ),
-    entryEnd( entryBuf.data() + entryBuf.size() ),
-    pointEnd( pointBuf.data() + pointBuf.size() )
+    RichQueryBase( fmt )
   {
   }
 
   RichQueryArgs::RichQueryArgs( const RichQueryArgs& source, const Bounds& bounds, bool exceptIfNULL ):
-    RichQueryBase( source, bounds ),
-    entryBuf( 0x10000 ),
-    pointBuf( 0x10000 ),
-    entryEnd( entryBuf.data() + entryBuf.size() ),
-    pointEnd( pointBuf.data() + pointBuf.size() )
+    RichQueryBase( source, bounds )
   {
     for ( auto& next: source.querySet )
     {
@@ -589,6 +601,27 @@ namespace queries {
       throw uninitialized_exception( "empty query @" __FILE__ LINE_STRING );
   }
 
+  auto  RichQueryArgs::ReserveOutput( size_t nents, size_t npos ) -> std::pair<EntrySet*, EntryPos*>
+  {
+    nents = std::min( nents, maxEntries );
+    npos = std::min( npos, maxEntries );
+
+    entryEnd = entryBuf.Reserve( nents ) + nents;
+    pointEnd = pointBuf.Reserve( npos ) + npos;
+
+    return { entryBuf.data(), pointBuf.data() };
+  }
+
+  auto  RichQueryArgs::MaxSpread( const Abstract& abstract ) -> size_t
+  {
+    auto  maxlen = size_t(0);
+
+    for ( auto& next: abstract.entries )
+      maxlen = std::max( maxlen, next.spread.size() );
+
+    return maxlen;
+  }
+
   void  RichQueryArgs::AddQueryNode( mtc::api<RichQueryBase> query, double range )
   {
     double  rgsumm = 0.0;
@@ -667,14 +700,26 @@ namespace queries {
   {
     if ( abstract.dwMode != abstract.Rich )
     {
-      auto  outEnt = entryBuf.data();
-      auto  outPos = pointBuf.data();
+      auto  nCount = size_t(0);
+      auto  nSpread = size_t(0);
 
     // request all the queries in '&' operator; not found queries force to return {}
       for ( auto& next: querySet )
         if ( next.GetChunks( udocid, format, limits ).entries.empty() )
           return abstract = {};
 
+    // each tuple shifts at least one of the entries and copies the current points;
+    // a spare point keeps the filled buffer from being taken for an overflow
+      for ( auto& next: querySet )
+      {
+        nCount += next.abstract.entries.size();
+        nSpread += MaxSpread( next.abstract );
+      }
+
+      auto  outPtr = ReserveOutput( nCount, nCount * nSpread + 1 );
+      auto  outEnt = outPtr.first;
+      auto  outPos = outPtr.second;
+
     // list elements and select the best tuples for each possible compact entry;
     // shrink overlapping entries to suppress far and low-weight entries
       for ( bool hasAny = true; hasAny && outEnt != entryEnd && outPos != pointEnd; )
@@ -733,14 +778,21 @@ namespace queries {
   {
     if ( abstract.dwMode != abstract.Rich )
     {
-      auto  outEnt = entryBuf.data();
-      auto  outPos = pointBuf.data();
+      auto  nCount = maxEntries;
 
     // request all the queries in '&' operator; not found queries force to return {}
       for ( auto& next: querySet )
         if ( next.GetChunks( udocid, format, limits ).entries.empty() )
           return abstract = {};
 
+    // each sequence shifts all the entries and copies a point per query, plus a spare
+      for ( auto& next: querySet )
+        nCount = std::min( nCount, next.abstract.entries.size() );
+
+      auto  outPtr = ReserveOutput( nCount, nCount * querySet.size() + 1 );
+      auto  outEnt = outPtr.first;
+      auto  outPos = outPtr.second;
+
     // list elements and select the best tuples for each possible compact entry;
     // shrink overlapping entries to suppress far and low-weight entries
       while ( outEnt != entryEnd )
@@ -899,11 +951,11 @@ namespace queries {
   {
     if ( abstract.dwMode != abstract.Rich )
     {
-      auto  outEnt = entryBuf.data();
-      auto  outPos = pointBuf.data();
       auto  loaded = size_t(0);
       auto  quo_fl = double(0.0);
       auto  qUpper = unsigned(0);   // верхний предел для кворумных элементов
+      auto  nCount = size_t(0);
+      auto  nSpread = size_t(0);
 
     // для начала загрузить потенциально дающие кворум подзапросы, чтобы избежать
     // распаковки потенциально ненужных
@@ -914,6 +966,19 @@ namespace queries {
           qUpper = std::max( qUpper, querySet[loaded].abstract.entries.back().limits.uMax + 100 );
         }
 
+    // размер выдачи известен, только если загружены все подзапросы; иначе
+    // дозагружаемые подзапросы могут дать до maxEntries вхождений
+      for ( auto& next: querySet )
+      {
+        nCount += next.abstract.entries.size();
+        nSpread += MaxSpread( next.abstract );
+      }
+
+      auto  outPtr = loaded == querySet.size() ?
+        ReserveOutput( nCount, nCount * nSpread ) : ReserveOutput( maxEntries, maxEntries );
+      auto  outEnt = outPtr.first;
+      auto  outPos = outPtr.second;
+
     // list elements and select the best tuples for each possible compact entry;
     // shrink overlapping entries to suppress far and low-weight entries
       while ( outEnt != entryEnd && outPos != pointEnd )
@@ -1076,8 +1141,8 @@ namespace queries {
   {
     if ( abstract.dwMode != abstract.Rich )
     {
-      auto  outEnt = entryBuf.data();
       auto  nFound = size_t(0);
+      auto  nCount = size_t(0);
 
     // ensure selected allocated
       if ( selected.size() != querySet.size() )
@@ -1086,7 +1151,13 @@ namespace queries {
     // request all the queries in '&' operator; not found queries force to return {}
       for ( auto& next: querySet )
         if ( next.GetChunks( udocid, format, limits ).entries.size() != 0 )
+        {
+          nCount += next.abstract.entries.size();
           selected[nFound++] = &next.abstract;
+        }
+
+    // each output entry shifts at least one of the entries
+      auto  outEnt = ReserveOutput( nCount, 0 ).first;
 
     // list elements and select the best tuples for each possible compact entry;
     // shrink overlapping entries to suppress far and low-weight entries
@@ -1217,7 +1288,7 @@ namespace queries {
       auto  format = context::formats::FormatBox( ft );
       auto  fmtbeg = format.begin();
       auto  fmtend = format.end();
-      auto  outPtr = entryBuf;
+      auto  outPtr = entryBuf.data();
       bool  hasAny;
 
     // skip until the first matching format
@@ -1229,6 +1300,8 @@ namespace queries {
       {
         auto  entset = subQuery->GetChunks( id, ft, { std::max( limits.uLower, fmtbeg->uLower ), limits.uUpper  } );
 
+        outPtr = entryBuf.Reserve( entset.entries.size() );
+
         for ( ; entset.entries.pbeg != entset.entries.pend && fmtbeg != fmtend; ++entset.entries.pbeg )
         {
           while ( fmtbeg != fmtend && fmtbeg->uUpper < entset.entries.pbeg->limits.uMax && !mtc::bitset_get( matchSet, fmtbeg->format ) )
@@ -1251,8 +1324,8 @@ namespace queries {
         }
       }
 
-      if ( outPtr != entryBuf )
-        abstract = { Abstract::Rich, 0, { entryBuf, outPtr } };
+      if ( outPtr != entryBuf.data() )
+        abstract = { Abstract::Rich, 0, { entryBuf.data(), outPtr } };
     }
     return abstract;
   }
@@ -1274,7 +1347,7 @@ namespace queries {
       auto  format = context::formats::FormatBox( ft );
       auto  fmtbeg = format.begin();
       auto  fmtend = format.end();
-      auto  outPtr = entryBuf;
+      auto  outPtr = entryBuf.data();
       bool  hasAny;
 
       // skip until the first matching format
@@ -1286,6 +1359,8 @@ namespace queries {
       {
         auto  entset = subQuery->GetChunks( id, ft, { std::max( limits.uLower, fmtbeg->uLower ), limits.uUpper  } );
 
+        outPtr = entryBuf.Reserve( entset.entries.size() );
+
         for ( ; entset.entries.pbeg != entset.entries.pend && fmtbeg != fmtend; ++entset.entries.pbeg )
         {
           while ( fmtbeg != fmtend && fmtbeg->uUpper < entset.entries.pbeg->limits.uMax && !mtc::bitset_get( matchSet, fmtbeg->format ) )
@@ -1308,8 +1383,8 @@ namespace queries {
         }
       }
 
-      if ( outPtr != entryBuf )
-        abstract = { Abstract::Rich, 0, { entryBuf, outPtr } };
+      if ( outPtr != entryBuf.data() )
+        abstract = { Abstract::Rich, 0, { entryBuf.data(), outPtr } };
     }
     return abstract;
   }
@@ -1,4 +1,8 @@
 # include "../../rankers.hpp"
+# include "../workers-pool.hpp"
+# include <algorithm>
+# include <atomic>
+# include <thread>
 
 namespace structo {
 namespace rankers {
@@ -20,4 +24,181 @@ namespace rankers {
     return score;
   }
 
+ /*
+  * Term frequency never exceeds 1 and the length normalization is never less
+  * than (1 - b1), so the term contribution is limited by its value for tmfreq == 1
+  * and an empty document.
+  */
+  auto  BM25Bound( double dblIDF ) -> double
+  {
+    return std::max( dblIDF, 0.0 ) * (1 + k1) / (1 + k1 * (1 - b1));
+  }
+
+ /*
+  * For a single occurence tmfreq == 1 / nWords, so the BM25() term weight falls
+  * down fast with the length of the entity.
+  */
+  auto  BM25Bound( double dblIDF, unsigned nWords ) -> double
+  {
+    return std::max( dblIDF, 0.0 ) * (1 + k1) / (1 + 1.5 * nWords * (1 - b1 + b1 * nWords / 1000.0));
+  }
+
+  static  auto  BetterOf( const Ranked& a, const Ranked& b ) -> bool
+  {
+    return a.weight > b.weight || (a.weight == b.weight && a.entity < b.entity);
+  }
+
+ /*
+  * RankTopK( query, count, shared )
+  *
+  * Top-k selection for one query or one shard of a query. With shared threshold set,
+  * the shards exchange their current top-k thresholds: the best of them is a valid
+  * lower estimate for the k-th weight of the whole selection.
+  */
+  static  auto  RankTopK( queries::IQuery* query, size_t topK, std::atomic<double>* shared ) -> std::vector<Ranked>
+  {
+    auto  pruned = dynamic_cast<queries::IPrunedQuery*>( query );
+    auto  ranked = std::vector<Ranked>();
+    auto  better = []( const Ranked& a, const Ranked& b ){  return a.weight > b.weight;  };
+
+  // restore the threshold of the caller's query on return
+    struct  Restore
+    {
+      queries::IPrunedQuery*  pquery;
+      double                  weight;
+
+     ~Restore()
+      {
+        if ( pquery != nullptr )
+          pquery->SetMinWeight( weight );
+      }
+    } restore{ pruned, pruned != nullptr ? pruned->GetMinWeight() : 0.0 };
+
+    ranked.reserve( topK );
+
+    for ( auto docid = query->SearchDoc( 1 ); docid != uint32_t(-1); docid = query->SearchDoc( docid + 1 ) )
+    {
+      auto&   tuples = query->GetTuples( docid );
+      double  weight;
+      double  thresh;
+
+      if ( tuples.dwMode == tuples.None || (weight = BM25( tuples )) <= 0.0 )
+        continue;
+
+    // keep the worst of selected entities on the top of the heap
+      if ( ranked.size() == topK )
+      {
+        if ( weight <= ranked.front().weight )
+          continue;
+        std::pop_heap( ranked.begin(), ranked.end(), better );
+          ranked.back() = { docid, weight };
+        std::push_heap( ranked.begin(), ranked.end(), better );
+      }
+        else
+      {
+        ranked.push_back( { docid, weight } );
+        std::push_heap( ranked.begin(), ranked.end(), better );
+      }
+
+    // raise the threshold for the pruning query
+      thresh = ranked.size() == topK ? ranked.front().weight : 0.0;
+
+      if ( shared != nullptr )
+      {
+        auto  global = shared->load();
+
+        while ( global < thresh && !shared->compare_exchange_weak( global, thresh ) )
+          (void)NULL;
+
+        thresh = std::max( thresh, global );
+      }
+
+      if ( pruned != nullptr && thresh > 0.0 )
+        pruned->SetMinWeight( thresh );
+    }
+
+    std::sort_heap( ranked.begin(), ranked.end(), better );
+
+    return ranked;
+  }
+
+ /*
+  * RankPool()
+  *
+  * Persistent threads for the sharded evaluation: starting new threads for each query
+  * costs more than the sharding saves on short queries.
+  */
+  static  auto  RankPool() -> WorkersPool&
+  {
+    static WorkersPool rankPool( std::max( 1U, std::thread::hardware_concurrency() ) - 1 );
+
+    return rankPool;
+  }
+
+  auto  BM25TopK( const mtc::api<queries::IQuery>& query, size_t topK ) -> std::vector<Ranked>
+  {
+    if ( query == nullptr || topK == 0 )
+      return {};
+
+    return RankTopK( query.ptr(), topK, nullptr );
+  }
+
+  auto  BM25TopK( const mtc::api<queries::IQuery>& query, size_t topK, unsigned nThreads ) -> std::vector<Ranked>
+  {
+    auto  shards = std::vector<mtc::api<queries::IQuery>>();
+    auto  result = std::vector<std::vector<Ranked>>();
+    auto  ranked = std::vector<Ranked>();
+
+    if ( query == nullptr || topK == 0 )
+      return ranked;
+
+    if ( nThreads == 0 )
+      nThreads = std::max( 1U, std::thread::hardware_concurrency() );
+
+  // split the entities range to shards, a few per thread to balance uneven ranges
+    auto  uLimit = uint64_t(query->LastIndex()) + 1;
+    auto  nParts = std::min( uint64_t(nThreads) * 4, uLimit );
+    auto  ushard = (uLimit + nParts - 1) / std::max( nParts, uint64_t(1) );
+
+    if ( nThreads == 1 || nParts <= 1 )
+      return RankTopK( query.ptr(), topK, nullptr );
+
+    for ( auto uLower = uint64_t(1); uLower < uLimit; uLower += ushard )
+    {
+      auto  bounds = Bounds( uint32_t(uLower), uLower + ushard < uLimit ? uint32_t(uLower + ushard) : uint32_t(-1) );
+      auto  pshard = query->Duplicate( bounds );
+
+      if ( pshard != nullptr )
+        shards.push_back( pshard );
+    }
+
+  // evaluate the shards, no more than nThreads at once
+    {
+      auto  shared = std::atomic<double>( 0.0 );
+      auto  nextId = std::atomic<size_t>( 0 );
+
+      result.resize( shards.size() );
+
+      RankPool().Run( std::min( size_t(nThreads), shards.size() ), [&]( size_t )
+        {
+          for ( auto ishard = nextId++; ishard < shards.size(); ishard = nextId++ )
+            result[ishard] = RankTopK( shards[ishard].ptr(), topK, &shared );
+        } );
+    }
+
+  // merge the shards
+    for ( auto& next: result )
+      ranked.insert( ranked.end(), next.begin(), next.end() );
+
+    if ( ranked.size() > topK )
+    {
+      std::partial_sort( ranked.begin(), ranked.begin() + topK, ranked.end(), BetterOf );
+      ranked.resize( topK );
+    }
+      else
+    std::sort( ranked.begin(), ranked.end(), BetterOf );
+
+    return ranked;
+  }
+
 }}
@@ -7,6 +7,9 @@
 # include <fcntl.h>
 # include <stdexcept>
 # include <unistd.h>
+# include <algorithm>
+# include <cstring>
+# include <future>
 
 namespace structo {
 namespace storage {
@@ -17,7 +20,8 @@ namespace posixFS {
   * LinuxDirectOutput обеспечивает запись кусками прямо на диск, не сбивая
   * работу дискового кэша.
   *
-  * Простой поток, только накопление и запись страницами.
+  * Двойная буферизация: заполненный буфер записывается в фоне, пока данные
+  * копируются во второй, так что запись ограничена скоростью диска.
   */
   class LinuxDirectOutput final: public mtc::IByteStream
   {
@@ -38,30 +42,42 @@ namespace posixFS {
     uint32_t  Put( const void*, uint32_t ) override;
 
   protected:
-    void*       buffer = nullptr;
-    char*       bufptr;
-    const char* bufend;
-    int64_t     cbFile = 0;
-    int         fileno;
+    void  Flush();
+    void  Write( const void*, size_t );
+
+  protected:
+    void*             buffer = nullptr;     // the buffer being filled
+    void*             backup = nullptr;     // the buffer being written
+    size_t            buflen;
+    char*             bufptr;
+    const char*       bufend;
+    std::future<void> writing;
+    int64_t           cbFile = 0;
+    int               fileno;
   };
 
   // LinuxDirectOutput implementation
 
-  LinuxDirectOutput::LinuxDirectOutput( const char* filepath, size_t buflen )
+  LinuxDirectOutput::LinuxDirectOutput( const char* filepath, size_t length ):
+    buflen( (std::max( length, MemAlignDirectIO ) + MemAlignDirectIO - 1) & ~(MemAlignDirectIO - 1) )
   {
     if ( (fileno = open( filepath, O_CREAT + O_WRONLY + O_DIRECT, 0600 )) < 0 )
       throw mtc::FormatError<mtc::file_error>( "Could not open file '%s'", filepath );
 
     if ( posix_memalign( (void**)&buffer, MemAlignDirectIO, buflen ) != 0 )
-      throw std::bad_alloc();
+      throw close( fileno ), std::bad_alloc();
 
     bufend = (bufptr = static_cast<char*>( buffer )) + buflen;
   }
 
   LinuxDirectOutput::~LinuxDirectOutput()
   {
+    if ( writing.valid() )
+      writing.wait();
     if ( buffer != nullptr )
       free( buffer );
+    if ( backup != nullptr )
+      free( backup );
     if ( fileno >= 0 )
       close( fileno );
   }
@@ -78,18 +94,16 @@ namespace posixFS {
     // on object destruction, write file and truncate length
     if ( (rCount = --refCount) == 0 )
     {
+      auto  cbtail = size_t(bufptr - static_cast<char*>( buffer ));
       int   nerror;
 
-      if ( bufptr != static_cast<char*>( buffer ) )
-      {
-        if ( write( fileno, buffer, bufend - static_cast<const char*>( buffer ) ) != bufend - static_cast<const char*>( buffer ) )
-        {
-          nerror = errno;
+    // finish the background write and write the tail rounded up to the page
+      if ( writing.valid() )
+        writing.get();
+
+      if ( cbtail != 0 )
+        Write( buffer, (cbtail + MemAlignDirectIO - 1) & ~(MemAlignDirectIO - 1) );
 
-          throw mtc::FormatError<mtc::file_error>( "Error %d writing file ('%s')",
-            nerror, strerror( nerror ) );
-        }
-      }
       if ( ftruncate( fileno, cbFile ) != 0 )
       {
         nerror = errno;
@@ -117,22 +131,14 @@ namespace posixFS {
 
     while ( srcptr != srcend )
     {
-      // check if flush the buffer
-      if ( bufptr == bufend )
-      {
-        if ( write( fileno, buffer, bufend - static_cast<const char*>( buffer ) ) != bufend - static_cast<const char*>( buffer ) )
-        {
-          int   nerror = errno;
-
-          throw mtc::FormatError<mtc::file_error>( "Error writing file, error %d ('%s')",
-            nerror, strerror( nerror ) );
-        }
-        bufptr = static_cast<char*>( buffer );
-      }
+      auto  cbcopy = std::min( size_t(srcend - srcptr), size_t(bufend - bufptr) );
 
-      // copy next portion
-      while ( srcptr != srcend && bufptr != bufend )
-        *bufptr++ = *srcptr++;
+      memcpy( bufptr, srcptr, cbcopy );
+        bufptr += cbcopy;
+        srcptr += cbcopy;
+
+      if ( bufptr == bufend )
+        Flush();
     }
 
     cbFile += len;
@@ -140,16 +146,48 @@ namespace posixFS {
     return srcptr - static_cast<const char*>( buf );
   }
 
-  auto  CreateOutputStream( const char* filepath ) -> mtc::api<mtc::IByteStream>
+ /*
+  * Flush()
+  *
+  * Waits for the previous background write, passes the filled buffer to the next one
+  * and continues with the other buffer.
+  */
+  void  LinuxDirectOutput::Flush()
+  {
+    if ( writing.valid() )
+      writing.get();
+
+    if ( backup == nullptr && posix_memalign( (void**)&backup, MemAlignDirectIO, buflen ) != 0 )
+      throw std::bad_alloc();
+
+    std::swap( buffer, backup );
+      bufend = (bufptr = static_cast<char*>( buffer )) + buflen;
+
+    writing = std::async( std::launch::async, [this, output = backup]()
+      {  Write( output, buflen );  } );
+  }
+
+  void  LinuxDirectOutput::Write( const void* output, size_t length )
+  {
+    if ( write( fileno, output, length ) != ssize_t(length) )
+    {
+      int   nerror = errno;
+
+      throw mtc::FormatError<mtc::file_error>( "Error writing file, error %d ('%s')",
+        nerror, strerror( nerror ) );
+    }
+  }
+
+  auto  CreateOutputStream( const char* filepath, size_t buflen ) -> mtc::api<mtc::IByteStream>
   {
-    return new LinuxDirectOutput( filepath, 0x8000 );
+    return new LinuxDirectOutput( filepath, buflen != 0 ? buflen : 0x400 * 0x400 );
   }
 
 # else
 
-  auto  CreateOutputStream( const char* filepath ) -> mtc::api<mtc::IByteStream>
+  auto  CreateOutputStream( const char* filepath, size_t buflen ) -> mtc::api<mtc::IByteStream>
   {
-    return mtc::OpenBufStream( filepath, O_WRONLY, 0x8000, mtc::enable_exceptions );
+    return mtc::OpenBufStream( filepath, O_WRONLY, buflen != 0 ? buflen : 0x400 * 0x400, mtc::enable_exceptions );
   }
 
 # endif
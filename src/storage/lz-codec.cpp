@@ -0,0 +1,176 @@
+# include "lz-codec.hpp"
+# include <cstdint>
+# include <cstring>
+
+namespace structo {
+namespace storage {
+namespace lz {
+
+  enum: size_t
+  {
+    hash_bits = 12,
+    last_lits = 5                     // the tail is always stored as literals
+  };
+
+  inline  auto  Load32( const uint8_t* p ) -> uint32_t
+  {
+    uint32_t  u;
+
+    return memcpy( &u, p, sizeof(u) ), u;
+  }
+
+  inline  auto  HashOf( uint32_t u ) -> uint32_t
+  {
+    return (u * 2654435761U) >> (32 - hash_bits);
+  }
+
+  inline  auto  PutLength( uint8_t* o, size_t l ) -> uint8_t*
+  {
+    for ( ; l >= 0xff; l -= 0xff )
+      *o++ = 0xff;
+    return *o++ = uint8_t(l), o;
+  }
+
+  inline  auto  GetLength( const uint8_t*& s, const uint8_t* e, size_t& l ) -> bool
+  {
+    for ( uint8_t next = 0xff; next == 0xff; l += next )
+    {
+      if ( s == e )
+        return false;
+      next = *s++;
+    }
+    return true;
+  }
+
+  auto  Pack( const void* source, size_t length, void* output ) -> size_t
+  {
+    uint32_t  htable[1 << hash_bits];
+    auto      srcbeg = (const uint8_t*)source;
+    auto      srcend = srcbeg + length;
+    auto      srcptr = srcbeg;
+    auto      litbeg = srcbeg;
+    auto      outptr = (uint8_t*)output;
+
+    memset( htable, 0xff, sizeof(htable) );
+
+    if ( length > last_lits + min_match )
+    {
+      auto  matend = srcend - last_lits;
+      auto  cmpend = srcend - min_match;
+
+      while ( srcptr + min_match <= matend )
+      {
+        auto  sample = Load32( srcptr );
+        auto& hentry = htable[HashOf( sample )];
+        auto  prevAt = hentry;
+
+        hentry = uint32_t(srcptr - srcbeg);
+
+        if ( prevAt == uint32_t(-1) || hentry - prevAt > max_shift || Load32( srcbeg + prevAt ) != sample )
+        {
+          ++srcptr;
+          continue;
+        }
+
+      // extend the match up to the literal tail
+        auto  prefix = srcbeg + prevAt;
+        auto  matptr = srcptr + min_match;
+        auto  refptr = prefix + min_match;
+
+        while ( matptr < cmpend && *matptr == *refptr )
+          ++matptr, ++refptr;
+
+      // write the sequence
+        auto  litlen = size_t(srcptr - litbeg);
+        auto  matlen = size_t(matptr - srcptr) - min_match;
+        auto  offset = size_t(srcptr - prefix);
+        auto  ptoken = outptr++;
+
+        *ptoken = uint8_t((litlen < 15 ? litlen : 15) << 4) | uint8_t(matlen < 15 ? matlen : 15);
+
+        if ( litlen >= 15 )
+          outptr = PutLength( outptr, litlen - 15 );
+
+        memcpy( outptr, litbeg, litlen );
+          outptr += litlen;
+
+        *outptr++ = uint8_t(offset);
+        *outptr++ = uint8_t(offset >> 8);
+
+        if ( matlen >= 15 )
+          outptr = PutLength( outptr, matlen - 15 );
+
+        litbeg = srcptr = matptr;
+      }
+    }
+
+  // write the literal tail
+    auto  litlen = size_t(srcend - litbeg);
+
+    *outptr++ = uint8_t((litlen < 15 ? litlen : 15) << 4);
+
+    if ( litlen >= 15 )
+      outptr = PutLength( outptr, litlen - 15 );
+
+    memcpy( outptr, litbeg, litlen );
+
+    return outptr + litlen - (uint8_t*)output;
+  }
+
+  bool  Unpack( const void* source, size_t length, void* output, size_t outlen )
+  {
+    auto  srcptr = (const uint8_t*)source;
+    auto  srcend = srcptr + length;
+    auto  outbeg = (uint8_t*)output;
+    auto  outptr = outbeg;
+    auto  outend = outbeg + outlen;
+
+    while ( srcptr != srcend )
+    {
+      auto  ptoken = *srcptr++;
+      auto  litlen = size_t(ptoken >> 4);
+      auto  matlen = size_t(ptoken & 0x0f);
+      auto  offset = size_t(0);
+
+    // copy the literals
+      if ( litlen == 15 && !GetLength( srcptr, srcend, litlen ) )
+        return false;
+
+      if ( litlen > size_t(srcend - srcptr) || litlen > size_t(outend - outptr) )
+        return false;
+
+      memcpy( outptr, srcptr, litlen );
+        outptr += litlen;
+        srcptr += litlen;
+
+    // check for the last sequence
+      if ( srcptr == srcend )
+        break;
+
+    // copy the match
+      if ( srcend - srcptr < 2 )
+        return false;
+
+      offset = srcptr[0] | (size_t(srcptr[1]) << 8);
+        srcptr += 2;
+
+      if ( matlen == 15 && !GetLength( srcptr, srcend, matlen ) )
+        return false;
+
+      if ( offset == 0 || offset > size_t(outptr - outbeg) || (matlen += min_match) > size_t(outend - outptr) )
+        return false;
+
+      if ( offset >= matlen )
+      {
+        memcpy( outptr, outptr - offset, matlen );
+        outptr += matlen;
+      }
+        else
+      for ( auto refptr = outptr - offset; matlen-- != 0; )
+        *outptr++ = *refptr++;
+    }
+
+    return outptr == outend;
+  }
+
+}}}
@@ -0,0 +1,50 @@
+# if !defined( __structo_src_storage_lz_codec_hpp__ )
+# define __structo_src_storage_lz_codec_hpp__
+# include <cstddef>
+
+namespace structo {
+namespace storage {
+namespace lz {
+
+ /*
+  * Быстрый LZ77-кодек для пакетов документов.
+  *
+  * Поток сжатых данных - последовательность записей вида
+  *   token, [длина литералов], литералы, [смещение, [длина совпадения]],
+  * где старшие 4 бита token - длина литералов, младшие - длина совпадения без
+  * min_match; значение 15 продолжается байтами 255... до байта меньше 255.
+  * Смещение - 2 байта little-endian; последняя запись содержит только литералы.
+  */
+  enum: size_t
+  {
+    min_match = 4,
+    max_shift = 0xffff
+  };
+
+ /*
+  * GetMaxPackedLen( length )
+  *
+  * Returns the output buffer size enough to Pack() length bytes.
+  */
+  inline  auto  GetMaxPackedLen( size_t length ) -> size_t
+    {  return length + length / 0xff + 0x10;  }
+
+ /*
+  * Pack( source, length, output )
+  *
+  * Compresses the source to the output of at least GetMaxPackedLen( length ) bytes
+  * and returns the compressed data length.
+  */
+  auto  Pack( const void*, size_t, void* ) -> size_t;
+
+ /*
+  * Unpack( source, length, output, outlen )
+  *
+  * Decompresses the data to the output and returns true if exactly outlen bytes
+  * are restored; broken source data is never read or written out of the bounds.
+  */
+  bool  Unpack( const void*, size_t, void*, size_t );
+
+}}}
+
+# endif   // !__structo_src_storage_lz_codec_hpp__
@@ -1,65 +1,777 @@
 # include "posix-fs-dump-store.hpp"
-# include <mtc/recursive_shared_mutex.hpp>
+# include "lz-codec.hpp"
+# include "../../compat.hpp"
+# include <mtc/exceptions.h>
 # include <mtc/byteBuffer.h>
+# include <mtc/fileStream.h>
+# include <mtc/directory.h>
+# include <mtc/wcsstr.h>
+# include <sys/stat.h>
+# include <stdexcept>
+# include <unistd.h>
+# include <fcntl.h>
+# include <cstring>
+# include <atomic>
+# include <vector>
+# include <mutex>
+# include <map>
 
 namespace structo {
 namespace storage {
 namespace posixFS {
 
+ /*
+  * Формат файла пакетов:
+  *   signature, records...
+  *
+  * Формат записи пакета:
+  *   length, data[length]                              - length != 0, несжатая запись;
+  *   0, codec, length, stored, data[stored]            - запись, сжатая кодеком codec,
+  *                                                       или пустой пакет.
+  *
+  * Старые файлы не имеют сигнатуры и содержат только записи length, data[length],
+  * в том числе пустые; такие файлы читаются и дописываются в старом формате.
+  *
+  * Пакеты индекса хранятся в файлах:
+  *   <packages>            - собственный файл пакетов индекса;
+  *   <packages>.<n>        - жёсткие ссылки на файлы пакетов исходных индексов слияния;
+  *   <packages>.extents    - номера n и объёмы записей, на которые ссылается индекс:
+  *                           count, { n, length }[count].
+  *
+  * Позиция пакета содержит номер файла в старших extent_shift битах (0 - собственный
+  * файл), так что слияние ссылается на записи исходных файлов без копирования. Счётчиком
+  * ссылок на файл служит число его жёстких ссылок: файл удаляется вместе с последним
+  * ссылающимся на него индексом. Файл, в котором индекс использует меньше половины
+  * объёма, при следующем слиянии не разделяется, а копируется по записям, и место
+  * удалённых записей освобождается вместе с последней ссылкой на файл.
+  */
+  struct RecordHead
+  {
+    size_t  codec;
+    size_t  length;                   // bundle length
+    size_t  stored;                   // stored data length
+  };
+
+  static const char signature[] = { '\0', 's', 'x', '-', 'p', 'a', 'c', 'k' };
+
+  const unsigned  extent_shift = 48;
+  const int64_t   extent_mask = (int64_t(1) << extent_shift) - 1;
+
+  static  bool  IsLegacyFile( const char* head, size_t size )
+  {
+    return size != 0 && (size < sizeof(signature) || memcmp( head, signature, sizeof(signature) ) != 0);
+  }
+
+  static  auto  FetchHead( const char* src, RecordHead& head, bool legacy ) -> const char*
+  {
+    if ( (src = ::FetchFrom( src, head.length )) == nullptr )
+      return nullptr;
+
+    if ( head.length != 0 || legacy )
+      return head.codec = uncompressed, head.stored = head.length, src;
+
+    return ::FetchFrom( ::FetchFrom( ::FetchFrom( src,
+      head.codec ),
+      head.length ),
+      head.stored );
+  }
+
+ /*
+  * Decode( head, stored )
+  *
+  * Restores the bundle of the compressed record; returns nullptr for unknown codec
+  * or broken data.
+  */
+  static  auto  Decode( const RecordHead& head, const char* stored ) -> mtc::api<const mtc::IByteBuffer>
+  {
+    if ( head.codec == lz_compressed )
+    {
+      auto  output = mtc::CreateByteBuffer( head.length, mtc::enable_exceptions );
+
+      if ( lz::Unpack( stored, head.stored, (char*)output->GetPtr(), head.length ) )
+        return output.ptr();
+    }
+    return nullptr;
+  }
+
+  class MappedStore;
+  class PackageSet;
+  class PackageSink;
+
+ /*
+  * DumpStore пишет пакеты без блокировок: место под запись резервируется атомарным
+  * сдвигом конца файла, а сама запись выполняется pwrite() в зарезервированный
+  * диапазон, так что параллельные Put() не ждут друг друга. Сигнатура нового файла
+  * пишется вместе с первой записью.
+  */
   class DumpStore final: public IStorage::IBundleRepo
   {
     implement_lifetime_control
 
+    enum: size_t
+    {
+      min_packed_len = 0x40         // shorter bundles are stored as is
+    };
+
   public:
-    DumpStore( const mtc::api<mtc::IFlatStream>& fl ): file( fl ) {}
+    DumpStore( const mtc::api<mtc::IFlatStream>& fl, Codec cc );
 
     auto  Get( int64_t ) const -> mtc::api<const mtc::IByteBuffer> override;
     auto  Put( const void*, size_t ) -> int64_t override;
+    auto  Copy( const IBundleRepo&, int64_t ) -> int64_t override;
+
+    auto  GetRecordLen( int64_t ) const -> size_t;
+
+  protected:
+    auto  Load( int64_t, bool withHead, RecordHead& ) const -> mtc::api<const mtc::IByteBuffer>;
+    auto  Reserve( size_t ) -> int64_t;
+    void  PutAt( const char*, size_t, int64_t );
 
   protected:
     mtc::api<mtc::IFlatStream>  file;
-    std::mutex                  lock;
+    const Codec                 codec;
+    std::atomic<int64_t>        endpos;
+    bool                        legacy = false;     // no signature, old records format
+    bool                        created = false;    // the signature is not written yet
+
+  };
+
+ /*
+  * MappedStore обеспечивает доступ на чтение к целиком отображённому в память файлу
+  * пакетов: Get() возвращает ссылку на запись без чтения файла и копирования.
+  */
+  class MappedStore final: public IStorage::IBundleRepo
+  {
+    class Record;
+
+    implement_lifetime_control
+
+  public:
+    MappedStore( const mtc::api<const mtc::IByteBuffer>& mp ):
+      mapped( mp ),
+      legacy( IsLegacyFile( mp->GetPtr(), mp->GetLen() ) ) {}
+
+    auto  Get( int64_t ) const -> mtc::api<const mtc::IByteBuffer> override;
+    auto  Put( const void*, size_t ) -> int64_t override
+      {  throw std::logic_error( "MappedStore::Put() must not be called @" __FILE__ ":" LINE_STRING );  }
+
+    auto  GetRecord( int64_t, RecordHead& ) const -> mtc::span<const char>;
+    bool  IsLegacy() const  {  return legacy;  }
+
+  protected:
+    mtc::api<const mtc::IByteBuffer>  mapped;
+    const bool                        legacy;
+
+  };
+
+  class MappedStore::Record final: public mtc::IByteBuffer
+  {
+    implement_lifetime_control
+
+  public:
+    Record( const char* p, size_t l, const MappedStore* o ):
+      bufptr( p ),
+      length( l ),
+      holder( o ) {}
+
+  public:
+    auto  GetPtr() const -> const char* override
+      {  return bufptr;  }
+    auto  GetLen() const -> size_t override
+      {  return length;  }
+    int   SetBuf( const void*, size_t ) override
+      {  throw std::logic_error( "not implemented @" __FILE__ ":" LINE_STRING );  }
+    int   SetLen( size_t ) override
+      {  throw std::logic_error( "not implemented @" __FILE__ ":" LINE_STRING );  }
+
+  protected:
+    const char*                   bufptr;
+    size_t                        length;
+    mtc::api<const MappedStore>   holder;
+
+  };
+
+  struct PackageFile
+  {
+    std::string                     path;
+    uint64_t                        used;       // the length of records in use
+    mtc::api<IStorage::IBundleRepo> store;
+  };
+
+ /*
+  * PackageSet обеспечивает доступ на чтение к пакетам сериализованного индекса, хранимым
+  * в собственном файле и в разделяемых файлах исходных индексов.
+  */
+  class PackageSet final: public IStorage::IBundleRepo
+  {
+    friend class DumpStore;
+    friend class PackageSink;
+
+    implement_lifetime_control
+
+  public:
+    PackageSet( std::vector<PackageFile>&& files ):
+      extents( std::move( files ) ) {}
+
+    auto  Get( int64_t ) const -> mtc::api<const mtc::IByteBuffer> override;
+    auto  Put( const void*, size_t ) -> int64_t override;
+
+  protected:
+    auto  GetFile( int64_t ) const -> const PackageFile*;
+
+  protected:
+    std::vector<PackageFile>  extents;    // by the file number; [0] is the own file
 
   };
 
-  auto  CreateDumpStore( const mtc::api<mtc::IFlatStream>& st ) -> mtc::api<IStorage::IBundleRepo>
+ /*
+  * PackageSink пишет пакеты создаваемого индекса в собственный файл, а записи пакетов
+  * сериализованных индексов не копирует, а ссылается на них, создав жёсткую ссылку на
+  * исходный файл. Разделяются только достаточно большие файлы, в которых исходный индекс
+  * использует не меньше половины объёма, и не более max_extents файлов на индекс; записи
+  * остальных файлов, а также файлов, на которые не удалось создать ссылку (например,
+  * в другой файловой системе), копируются.
+  */
+  class PackageSink final: public IPackageSink
+  {
+    implement_lifetime_control
+
+    enum: size_t
+    {
+      min_shared_len = 0x100000,    // smaller files are copied
+      max_extents = 0x40            // files shared by an index
+    };
+
+    struct Extent
+    {
+      mtc::api<IStorage::IBundleRepo> store;
+      uint64_t                        used;
+    };
+
+  public:
+    PackageSink( const std::string& path, const mtc::api<IStorage::IBundleRepo>& dumps ):
+      ownPath( path ),
+      ownDump( dumps ),
+      extents( 1 ) {}
+
+    auto  Get( int64_t ) const -> mtc::api<const mtc::IByteBuffer> override;
+    auto  Put( const void* pv, size_t cb ) -> int64_t override
+      {  return ownDump->Put( pv, cb );  }
+    auto  Copy( const IBundleRepo&, int64_t ) -> int64_t override;
+    void  Commit() override;
+
+    auto  GetStore( int64_t ) const -> mtc::api<IStorage::IBundleRepo>;
+
+  protected:
+    auto  Share( const PackageFile& ) -> size_t;
+
+  protected:
+    const std::string                         ownPath;
+    const mtc::api<IStorage::IBundleRepo>     ownDump;
+    mutable std::mutex                        mxLock;
+    std::map<std::pair<dev_t, ino_t>, size_t> fileIds;    // 0 - the file is copied
+    std::vector<Extent>                       extents;    // [0] is the own file
+
+  };
+
+  static  auto  GetRecordLen( const IStorage::IBundleRepo& store, int64_t po ) -> size_t
+  {
+    RecordHead  rdhead;
+
+    if ( auto mapped = dynamic_cast<const MappedStore*>( &store ) )
+      return mapped->GetRecord( po, rdhead ).size();
+    if ( auto dumped = dynamic_cast<const DumpStore*>( &store ) )
+      return dumped->GetRecordLen( po );
+    return 0;
+  }
+
+  static  auto  LoadExtents( const std::string& path ) -> std::vector<std::pair<size_t, uint64_t>>
+  {
+    auto  infile = mtc::OpenFileStream( (path + ".extents").c_str(), O_RDONLY, mtc::disable_exceptions );
+    auto  loaded = mtc::api<const mtc::IByteBuffer>();
+    auto  extset = std::vector<std::pair<size_t, uint64_t>>();
+    auto  srcptr = (const char*)nullptr;
+    auto  srcend = (const char*)nullptr;
+    size_t  ncount;
+
+    if ( infile == nullptr || infile->Size() == 0 )
+      return extset;
+
+    if ( infile->Size() > 0x10000 || (loaded = infile->PGet( 0, uint32_t(infile->Size()) ).ptr()) == nullptr )
+      throw std::invalid_argument( "invalid packages extents file @" __FILE__ ":" LINE_STRING );
+
+    srcend = (srcptr = loaded->GetPtr()) + loaded->GetLen();
+
+    if ( (srcptr = ::FetchFrom( srcptr, ncount )) == nullptr || ncount > 0x1000 )
+      throw std::invalid_argument( "invalid packages extents file @" __FILE__ ":" LINE_STRING );
+
+    for ( extset.resize( ncount ); srcptr != nullptr && ncount-- != 0; )
+      srcptr = ::FetchFrom( ::FetchFrom( srcptr, extset[extset.size() - ncount - 1].first ),
+        extset[extset.size() - ncount - 1].second );
+
+    if ( srcptr == nullptr || srcptr > srcend )
+      throw std::invalid_argument( "invalid packages extents file @" __FILE__ ":" LINE_STRING );
+
+    return extset;
+  }
+
+  auto  CreateDumpStore( const mtc::api<mtc::IFlatStream>& st, Codec cc ) -> mtc::api<IStorage::IBundleRepo>
   {
-    return st != nullptr ? new DumpStore( st ) : nullptr;
+    return st != nullptr ? new DumpStore( st, cc ) : nullptr;
+  }
+
+  auto  CreateDumpStore( const mtc::api<const mtc::IByteBuffer>& mp ) -> mtc::api<IStorage::IBundleRepo>
+  {
+    return mp != nullptr ? new MappedStore( mp ) : nullptr;
+  }
+
+  auto  CreatePackageSink( const std::string& path, Codec cc ) -> mtc::api<IPackageSink>
+  {
+    auto  dumps = CreateDumpStore( mtc::OpenFileStream( path.c_str(), O_RDWR ).ptr(), cc );
+
+    return dumps != nullptr ? new PackageSink( path, dumps ) : nullptr;
+  }
+
+  auto  OpenPackages( const std::string& path, const PackageOpener& open ) -> mtc::api<IStorage::IBundleRepo>
+  {
+    auto  extset = LoadExtents( path );
+    auto  files = std::vector<PackageFile>( 1 );
+    struct stat fstats;
+
+    if ( (files[0].store = open( path )) != nullptr )
+      files[0] = { path, uint64_t(stat( path.c_str(), &fstats ) == 0 ? fstats.st_size : 0), files[0].store };
+
+    for ( auto& next: extset )
+    {
+      if ( next.first == 0 || next.first > extent_mask )
+        throw std::invalid_argument( "invalid packages extents file @" __FILE__ ":" LINE_STRING );
+
+      if ( next.first >= files.size() )
+        files.resize( next.first + 1 );
+
+      files[next.first] = { mtc::strprintf( "%s.%u", path.c_str(), unsigned(next.first) ), next.second, nullptr };
+
+      if ( (files[next.first].store = open( files[next.first].path )) == nullptr )
+        throw mtc::file_error( mtc::strprintf( "could not open shared packages file '%s'", files[next.first].path.c_str() ) );
+    }
+
+    return files[0].store != nullptr || files.size() > 1 ? new PackageSet( std::move( files ) ) : nullptr;
+  }
+
+  void  RemovePackages( const std::string& path )
+  {
+    auto  diread = mtc::directory::Open( (path + ".*").c_str(), mtc::directory::attr_file );
+
+    for ( auto dirent = diread.Get(); dirent; dirent = diread.Get() )
+      remove( mtc::strprintf( "%s%s", dirent.folder(), dirent.string() ).c_str() );
+
+    remove( path.c_str() );
   }
 
   // DumpStore implementation
 
+  DumpStore::DumpStore( const mtc::api<mtc::IFlatStream>& fl, Codec cc ):
+    file( fl ),
+    codec( cc ),
+    endpos( fl->Size() )
+  {
+    char  header[sizeof(signature)];
+
+    if ( endpos != 0 )
+    {
+      auto  cbread = file->PGet( header, 0, sizeof(header) );
+
+      legacy = IsLegacyFile( header, cbread > 0 ? size_t(cbread) : 0 );
+    }
+      else
+    endpos = sizeof(signature), created = true;
+  }
+
   auto  DumpStore::Get( int64_t po ) const -> mtc::api<const mtc::IByteBuffer>
   {
-    char  blkbuf[0x1000];
-    auto  cbread = file->PGet( blkbuf, po, sizeof(blkbuf) );
+    RecordHead  rdhead;
+    auto        stored = Load( po, false, rdhead );
 
-    if ( cbread >= 10 )
+    if ( stored == nullptr || rdhead.codec == uncompressed )
+      return stored;
+
+    return Decode( rdhead, stored->GetPtr() );
+  }
+
+ /*
+  * Load( po, withHead, head )
+  *
+  * Reads the stored data of the record, with the record header if requested.
+  */
+  auto  DumpStore::Load( int64_t po, bool withHead, RecordHead& rdhead ) const -> mtc::api<const mtc::IByteBuffer>
+  {
+    char        blkbuf[0x1000];
+    auto        cbread = file->PGet( blkbuf, po, sizeof(blkbuf) );
+    const char* datptr;
+
+    if ( cbread <= 0 )
+      return nullptr;
+
+  // zero the tail to never fetch the header out of the data read
+    memset( blkbuf + cbread, 0, sizeof(blkbuf) - cbread );
+
+    if ( (datptr = FetchHead( blkbuf, rdhead, legacy )) == nullptr || datptr > blkbuf + cbread )
+      return nullptr;
+
+    auto    bufptr = withHead ? (const char*)blkbuf : datptr;
+    auto    cbload = size_t(datptr - bufptr) + rdhead.stored;
+    auto    getbuf = mtc::CreateByteBuffer( cbload, mtc::enable_exceptions );
+    size_t  cbcopy;
+
+    memcpy( (void*)getbuf->GetPtr(), bufptr, cbcopy = std::min( size_t(cbread - (bufptr - blkbuf)), cbload ) );
+
+    if ( cbcopy < cbload )
+      file->PGet( cbcopy + (char*)getbuf->GetPtr(), po + cbread, cbload - cbcopy );
+
+    return getbuf.ptr();
+  }
+
+  auto  DumpStore::GetRecordLen( int64_t po ) const -> size_t
+  {
+    char        header[0x40];
+    auto        cbread = po >= 0 ? file->PGet( header, po, sizeof(header) ) : 0;
+    const char* datptr;
+    RecordHead  rdhead;
+
+    if ( cbread <= 0 )
+      return 0;
+
+    memset( header + cbread, 0, sizeof(header) - cbread );
+
+    if ( (datptr = FetchHead( header, rdhead, legacy )) == nullptr || datptr > header + cbread )
+      return 0;
+
+    if ( rdhead.stored > uint64_t(endpos - po) - (datptr - header) )
+      return 0;
+
+    return (datptr - header) + rdhead.stored;
+  }
+
+  auto  DumpStore::Put( const void* pv, size_t cb ) -> int64_t
+  {
+    thread_local std::vector<char> packed;
+
+    auto  rdhead = RecordHead{ uncompressed, cb, cb };
+    auto  stored = (const char*)pv;
+    char  header[0x1000];
+    char* hdrend = header;
+
+  // try compress the bundle; keep it as is if it shrinks by less than 1/8
+    if ( codec == lz_compressed && cb >= min_packed_len && !legacy )
     {
-      size_t  buflen;
-      auto    bufptr = ::FetchFrom( const_cast<const char*>( blkbuf ), buflen );
-      auto    getbuf = mtc::CreateByteBuffer( buflen, mtc::enable_exceptions );
-      size_t  cbcopy;
+      packed.resize( lz::GetMaxPackedLen( cb ) );
+
+      if ( (rdhead.stored = lz::Pack( pv, cb, packed.data() )) < cb - cb / 8 )
+        rdhead.codec = lz_compressed, stored = packed.data();
+      else
+        rdhead.stored = cb;
+    }
 
-      memcpy( (void*)getbuf->GetPtr(), bufptr, cbcopy = std::min( size_t(cbread - (bufptr - blkbuf)), buflen ) );
+    if ( (rdhead.codec != uncompressed || cb == 0) && !legacy )
+    {
+      hdrend = ::Serialize( ::Serialize( ::Serialize( ::Serialize( hdrend,
+        size_t(0) ),
+        rdhead.codec ),
+        rdhead.length ),
+        rdhead.stored );
+    }
+      else
+    hdrend = ::Serialize( hdrend, cb );
 
-      if ( cbcopy < buflen )
-        file->PGet( cbcopy + (char*)getbuf->GetPtr(), po + cbread, buflen - cbcopy );
+  // reserve the record range and write it out of any lock; short records are
+  // written by one call
+    auto  cbhead = size_t(hdrend - header);
+    auto  putpos = Reserve( cbhead + rdhead.stored );
 
-      return getbuf.ptr();
+    if ( cbhead + rdhead.stored <= sizeof(header) )
+    {
+      memcpy( hdrend, stored, rdhead.stored );
+      PutAt( header, cbhead + rdhead.stored, putpos );
     }
-    return nullptr;
+      else
+    {
+      PutAt( header, cbhead, putpos );
+      PutAt( stored, rdhead.stored, putpos + cbhead );
+    }
+
+    return putpos;
   }
 
-  auto  DumpStore::Put( const void* pv, size_t cb ) -> int64_t
+  auto  DumpStore::Reserve( size_t length ) -> int64_t
   {
-    auto  exlock = mtc::make_unique_lock( lock );
-    auto  putpos = file->Size();
+    auto  putpos = endpos.fetch_add( length );
 
-    ::Serialize(
-    ::Serialize( file.ptr(), cb ), pv, cb );
+    if ( created && putpos == int64_t(sizeof(signature)) )
+      PutAt( signature, sizeof(signature), 0 );
 
     return putpos;
   }
 
+  void  DumpStore::PutAt( const char* data, size_t size, int64_t offset )
+  {
+    while ( size != 0 )
+    {
+      auto  cbpart = uint32_t(std::min( size, size_t(0x40000000) ));
+      auto  cbdone = file->PPut( data, offset, cbpart );
+
+      if ( cbdone <= 0 )
+      {
+        throw mtc::file_error( mtc::strprintf( "could not write the bundle, error %d (%s)",
+          errno, strerror( errno ) ) );
+      }
+
+      data += cbdone;
+      size -= cbdone;
+      offset += cbdone;
+    }
+  }
+
+ /*
+  * The records of the dump stores are copied in the stored form: the compressed
+  * bundles are not decoded and encoded again, and the mapped records are written
+  * straight from the mapping. The records stored differently in the old and the
+  * new format, the empty and the compressed ones, are read and put again.
+  */
+  auto  DumpStore::Copy( const IBundleRepo& source, int64_t po ) -> int64_t
+  {
+    RecordHead  rdhead;
+    int64_t     putpos;
+
+    if ( auto shared = dynamic_cast<const PackageSet*>( &source ) )
+    {
+      auto  infile = shared->GetFile( po );
+
+      return infile != nullptr ? Copy( *infile->store.ptr(), po & extent_mask ) : -1;
+    }
+      else
+    if ( auto pasink = dynamic_cast<const PackageSink*>( &source ) )
+    {
+      auto  pstore = pasink->GetStore( po );
+
+      return pstore != nullptr ? Copy( *pstore.ptr(), po & extent_mask ) : -1;
+    }
+      else
+    if ( auto mapped = dynamic_cast<const MappedStore*>( &source ) )
+    {
+      auto  record = mapped->GetRecord( po, rdhead );
+
+      if ( record.size() == 0 )
+        return -1;
+
+      if ( mapped->IsLegacy() == legacy || (rdhead.codec == uncompressed && rdhead.length != 0) )
+        return PutAt( record.data(), record.size(), putpos = Reserve( record.size() ) ), putpos;
+    }
+      else
+    if ( auto dumped = dynamic_cast<const DumpStore*>( &source ) )
+    {
+      auto  record = dumped->Load( po, true, rdhead );
+
+      if ( record == nullptr )
+        return -1;
+
+      if ( dumped->legacy == legacy || (rdhead.codec == uncompressed && rdhead.length != 0) )
+        return PutAt( record->GetPtr(), record->GetLen(), putpos = Reserve( record->GetLen() ) ), putpos;
+    }
+
+    return IBundleRepo::Copy( source, po );
+  }
+
+  // MappedStore implementation
+
+  auto  MappedStore::Get( int64_t po ) const -> mtc::api<const mtc::IByteBuffer>
+  {
+    RecordHead  rdhead;
+    auto        record = GetRecord( po, rdhead );
+    const char* bufptr;
+
+    if ( record.size() == 0 )
+      return nullptr;
+
+    bufptr = record.data() + record.size() - rdhead.stored;
+
+    if ( rdhead.codec == uncompressed )
+      return new Record( bufptr, rdhead.stored, this );
+
+    return Decode( rdhead, bufptr );
+  }
+
+ /*
+  * GetRecord( po, head )
+  *
+  * Returns the whole stored record, the header included, or an empty span.
+  */
+  auto  MappedStore::GetRecord( int64_t po, RecordHead& rdhead ) const -> mtc::span<const char>
+  {
+    auto  mapbeg = mapped->GetPtr();
+    auto  mapend = mapped->GetPtr() + mapped->GetLen();
+    auto  bufptr = (const char*)nullptr;
+
+    if ( po < 0 || size_t(po) >= mapped->GetLen() )
+      return { nullptr, 0 };
+
+    if ( (bufptr = FetchHead( mapbeg + po, rdhead, legacy )) == nullptr || bufptr > mapend || rdhead.stored > size_t(mapend - bufptr) )
+      return { nullptr, 0 };
+
+    return { mapbeg + po, size_t(bufptr + rdhead.stored - (mapbeg + po)) };
+  }
+
+  // PackageSet implementation
+
+  auto  PackageSet::Get( int64_t po ) const -> mtc::api<const mtc::IByteBuffer>
+  {
+    auto  infile = GetFile( po );
+
+    return infile != nullptr ? infile->store->Get( po & extent_mask ) : nullptr;
+  }
+
+  auto  PackageSet::Put( const void* pv, size_t cb ) -> int64_t
+  {
+    if ( extents[0].store == nullptr )
+      throw std::logic_error( "PackageSet::Put() without own packages file @" __FILE__ ":" LINE_STRING );
+    return extents[0].store->Put( pv, cb );
+  }
+
+ /*
+  * GetFile( po )
+  *
+  * Returns the packages file the position addresses, or nullptr.
+  */
+  auto  PackageSet::GetFile( int64_t po ) const -> const PackageFile*
+  {
+    auto  fileId = size_t(po >> extent_shift);
+
+    if ( po < 0 || fileId >= extents.size() || extents[fileId].store == nullptr )
+      return nullptr;
+
+    return &extents[fileId];
+  }
+
+  // PackageSink implementation
+
+  auto  PackageSink::Get( int64_t po ) const -> mtc::api<const mtc::IByteBuffer>
+  {
+    auto  pstore = GetStore( po );
+
+    return pstore != nullptr ? pstore->Get( po & extent_mask ) : nullptr;
+  }
+
+ /*
+  * GetStore( po )
+  *
+  * Returns the own or the shared store the position addresses, or nullptr.
+  */
+  auto  PackageSink::GetStore( int64_t po ) const -> mtc::api<IStorage::IBundleRepo>
+  {
+    auto  fileId = size_t(po >> extent_shift);
+
+    if ( po < 0 || fileId == 0 )
+      return ownDump;
+
+    auto  exlock = std::unique_lock<std::mutex>( mxLock );
+
+    return fileId < extents.size() ? extents[fileId].store : nullptr;
+  }
+
+ /*
+  * The records of the serialized indices are referenced in the shared source files;
+  * the other records are copied to the own packages file.
+  */
+  auto  PackageSink::Copy( const IBundleRepo& source, int64_t po ) -> int64_t
+  {
+    auto  shared = dynamic_cast<const PackageSet*>( &source );
+    auto  infile = shared != nullptr ? shared->GetFile( po ) : nullptr;
+    auto  fileId = size_t(0);
+    auto  reclen = size_t(0);
+
+    if ( infile == nullptr )
+      return shared != nullptr ? -1 : ownDump->Copy( source, po );
+
+    if ( (fileId = Share( *infile )) == 0 )
+      return ownDump->Copy( *infile->store.ptr(), po & extent_mask );
+
+    if ( (reclen = GetRecordLen( *infile->store.ptr(), po & extent_mask )) == 0 )
+      return -1;
+
+    {
+      auto  exlock = std::unique_lock<std::mutex>( mxLock );
+
+      extents[fileId].used += reclen;
+    }
+    return int64_t(fileId << extent_shift) | (po & extent_mask);
+  }
+
+ /*
+  * Share( file )
+  *
+  * Returns the number of the own link to the source packages file, creating the link
+  * on the first call, or 0 if the file records are copied.
+  */
+  auto  PackageSink::Share( const PackageFile& infile ) -> size_t
+  {
+    auto        exlock = std::unique_lock<std::mutex>( mxLock );
+    struct stat fstats;
+
+    if ( stat( infile.path.c_str(), &fstats ) != 0 )
+      return 0;
+
+    auto  fileKey = std::make_pair( fstats.st_dev, fstats.st_ino );
+    auto  pfound = fileIds.find( fileKey );
+    auto  tolink = std::string();
+
+    if ( pfound != fileIds.end() )
+      return pfound->second;
+
+    if ( extents.size() > max_extents || uint64_t(fstats.st_size) < min_shared_len || infile.used < uint64_t(fstats.st_size) / 2 )
+      return fileIds[fileKey] = 0;
+
+    if ( link( infile.path.c_str(), (tolink = mtc::strprintf( "%s.%u", ownPath.c_str(), unsigned(extents.size()) )).c_str() ) != 0 )
+      return fileIds[fileKey] = 0;
+
+    extents.push_back( { infile.store, 0 } );
+
+    return fileIds[fileKey] = extents.size() - 1;
+  }
+
+ /*
+  * Commit()
+  *
+  * Writes the list of the shared files with the lengths of the records in use.
+  */
+  void  PackageSink::Commit()
+  {
+    auto  exlock = std::unique_lock<std::mutex>( mxLock );
+    auto  output = std::vector<char>( 0x20 * extents.size() );
+    auto  outend = output.data();
+    auto  stpath = ownPath + ".extents";
+    int   handle;
+
+    if ( extents.size() == 1 )
+      return;
+
+    outend = ::Serialize( outend, extents.size() - 1 );
+
+    for ( size_t i = 1; i != extents.size(); ++i )
+      outend = ::Serialize( ::Serialize( outend, i ), extents[i].used );
+
+    if ( (handle = open( stpath.c_str(), O_CREAT + O_WRONLY + O_TRUNC, 0644 )) < 0 )
+    {
+      throw mtc::FormatError<mtc::file_error>( "could not open file '%s', error %d (%s)",
+        stpath.c_str(), errno, strerror( errno ) );
+    }
+
+    if ( write( handle, output.data(), outend - output.data() ) != outend - output.data() || fdatasync( handle ) < 0 )
+    {
+      close( handle );
+
+      throw mtc::FormatError<mtc::file_error>( "error writing file '%s', error %d (%s)",
+        stpath.c_str(), errno, strerror( errno ) );
+    }
+    close( handle );
+  }
+
 }}}
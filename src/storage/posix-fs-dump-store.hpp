@@ -1,9 +1,26 @@
-# include "../../contents.hpp"
+# include "../../storage/posix-fs.hpp"
+# include <functional>
 
 namespace structo {
 namespace storage {
 namespace posixFS {
 
-  auto  CreateDumpStore( const mtc::api<mtc::IFlatStream>& ) -> mtc::api<IStorage::IBundleRepo>;
+  auto  CreateDumpStore( const mtc::api<mtc::IFlatStream>&, Codec = uncompressed ) -> mtc::api<IStorage::IBundleRepo>;
+  auto  CreateDumpStore( const mtc::api<const mtc::IByteBuffer>& ) -> mtc::api<IStorage::IBundleRepo>;
+
+ /*
+  * IPackageSink - пакеты создаваемого индекса; Commit() сохраняет список разделяемых
+  * файлов пакетов исходных индексов, на записи которых ссылается индекс.
+  */
+  struct IPackageSink: IStorage::IBundleRepo
+  {
+    virtual void  Commit() = 0;
+  };
+
+  using PackageOpener = std::function<mtc::api<IStorage::IBundleRepo>( const std::string& )>;
+
+  auto  CreatePackageSink( const std::string&, Codec = uncompressed ) -> mtc::api<IPackageSink>;
+  auto  OpenPackages( const std::string&, const PackageOpener& ) -> mtc::api<IStorage::IBundleRepo>;
+  void  RemovePackages( const std::string& );
 
 }}}
@@ -34,7 +34,7 @@ namespace posixFS {
  /*
   * linux-specific implementation
   */
-  auto  CreateOutputStream( const char* filepath ) -> mtc::api<mtc::IByteStream>;
+  auto  CreateOutputStream( const char* filepath, size_t buflen = 0 ) -> mtc::api<mtc::IByteStream>;
 
   class Sink final: public IStorage::IIndexStore
   {
@@ -62,7 +62,7 @@ namespace posixFS {
     auto  Entities() -> mtc::api<mtc::IByteStream> override {  return entities;  }
     auto  Contents() -> mtc::api<mtc::IByteStream> override {  return contents;  }
     auto  Linkages() -> mtc::api<mtc::IByteStream> override {  return linkages;  }
-    auto  Packages() -> mtc::api<IStorage::IBundleRepo> override {  return packages;  }
+    auto  Packages() -> mtc::api<IStorage::IBundleRepo> override {  return packages.ptr();  }
 
     void  SetStats( const mtc::zmap& stats ) override {  idxStats = stats;  }
 
@@ -76,7 +76,7 @@ namespace posixFS {
     mtc::api<mtc::IByteStream>      entities;
     mtc::api<mtc::IByteStream>      contents;
     mtc::api<mtc::IByteStream>      linkages;
-    mtc::api<IStorage::IBundleRepo> packages;
+    mtc::api<IPackageSink>          packages;
 
     mtc::zmap                       idxStats;
 
@@ -112,6 +112,9 @@ namespace posixFS {
     if ( policy == nullptr )
       throw std::invalid_argument( "policy does not contain record for '.stats' file" );
 
+    if ( packages != nullptr )
+      packages->Commit();
+
     entities = nullptr;
     contents = nullptr;
     linkages = nullptr;
@@ -155,6 +158,9 @@ namespace posixFS {
     {
       auto  policy = policies.GetPolicy( unit );
 
+      if ( policy != nullptr && unit == Unit::packages )
+        RemovePackages( policy->GetFilePath( unit ) );
+      else
       if ( policy != nullptr )
         remove( policy->GetFilePath( unit ).c_str() );
     }
@@ -227,8 +233,8 @@ namespace posixFS {
       ->GetFilePath( contents ).c_str() );
     aSink.linkages = CreateOutputStream( aSink.policies.GetPolicy( linkages )
       ->GetFilePath( linkages ).c_str() );
-    aSink.packages = CreateDumpStore( mtc::OpenFileStream( aSink.policies.GetPolicy( packages )
-      ->GetFilePath( packages ).c_str(), O_RDWR ).ptr() );
+    aSink.packages = CreatePackageSink( aSink.policies.GetPolicy( packages )
+      ->GetFilePath( packages ), aSink.policies.GetPolicy( packages )->codec );
 
     return new Sink( std::move( aSink ) );
   }
@@ -88,7 +88,8 @@ namespace posixFS {
       policies.impl = new Impl( true );
 
       for ( auto& policy: *impl )
-        policies.impl->push_back( { policy.unit, policy.mode, mtc::strprintf( policy.path.c_str(), stamp ) } );
+        policies.impl->push_back( { policy.unit, policy.mode, mtc::strprintf( policy.path.c_str(), stamp ),
+          policy.codec, policy.access } );
     }
 
     return policies;
@@ -132,14 +133,14 @@ namespace posixFS {
     if ( impl == nullptr )
       impl = new Impl();
 
-    impl->push_back( { policy.unit, policy.mode, std::string( policy.path ) + ".%s" } );
+    impl->push_back( { policy.unit, policy.mode, std::string( policy.path ) + ".%s", policy.codec, policy.access } );
 
     return *this;
   }
 
-  auto  StoragePolicies::AddPolicy( Unit unit, Mode mode, std::string_view path ) -> StoragePolicies&
+  auto  StoragePolicies::AddPolicy( Unit unit, Mode mode, std::string_view path, Codec codec, Access access ) -> StoragePolicies&
   {
-    return AddPolicy( { unit, mode, std::string( path ).c_str() } );
+    return AddPolicy( { unit, mode, std::string( path ).c_str(), codec, access } );
   }
 
   auto  StoragePolicies::GetPolicy( Unit unit ) const -> const Policy*
@@ -7,6 +7,13 @@
 # include <mtc/wcsstr.h>
 # include <mtc/json.h>
 # include <stdexcept>
+# include <algorithm>
+# include <sys/mman.h>
+# include <unistd.h>
+# include <fcntl.h>
+# include <future>
+# include <atomic>
+# include <map>
 #include <mtc/bufStream.h>
 #include <mtc/directory.h>
 
@@ -33,7 +40,7 @@ namespace posixFS {
   /*
    * linux-specific implementation
    */
-  auto  CreateOutputStream( const char* filepath ) -> mtc::api<mtc::IByteStream>;
+  auto  CreateOutputStream( const char* filepath, size_t buflen = 0 ) -> mtc::api<mtc::IByteStream>;
 
   class Serialized final: public IStorage::ISerialized
   {
@@ -41,8 +48,14 @@ namespace posixFS {
 
     class Patch;
 
+    enum: size_t
+    {
+      compact_revisions = 2       // revision files count to be folded to one
+    };
+
   public:
     Serialized( const StoragePolicies& );
+   ~Serialized();
 
   public:
     auto  Entities() -> mtc::api<const mtc::IByteBuffer> override;
@@ -58,6 +71,11 @@ namespace posixFS {
     auto  AddPatch() -> mtc::api<IPatch> override;
     void  SetPatch( IPatch* ) override;
 
+  protected:
+    static  void  CompactPatches( std::string, std::vector<std::string>,
+      std::vector<mtc::api<const mtc::IByteBuffer>>,
+      std::map<std::string_view, std::pair<char, std::string_view>> );
+
   protected:
     const StoragePolicies             policies;
 
@@ -67,6 +85,7 @@ namespace posixFS {
     mtc::api<IStorage::IBundleRepo>   packages;
 
     mtc::zmap                         idxStats;
+    std::future<void>                 compactor;
 
   };
 
@@ -86,19 +105,122 @@ namespace posixFS {
 
   };
 
+ /*
+  * BlocksRepo
+  *
+  * Memory-mapped and preloaded linkages are loaded once per opened index, and Get()
+  * returns the slices of the mapping; file-based linkages and the ones too large to be
+  * preloaded are read by pread() into the heap, a block per call, up to 4 GB each.
+  */
   class BlocksRepo final: public IStorage::ICoordsRepo
   {
-    mtc::api<mtc::IFileStream>  fileStream;
+    class Slice;
+
+    mtc::api<mtc::IFileStream>        fileStream;
+    uint64_t                          fileLength = 0;
+    mtc::api<const mtc::IByteBuffer>  wholeBlock;
 
   public:
     BlocksRepo( const mtc::api<mtc::IFileStream>& in ):
-      fileStream( in )  {}
+      fileStream( in ),
+      fileLength( in->Size() )  {}
+    BlocksRepo( const mtc::api<const mtc::IByteBuffer>& mp ):
+      wholeBlock( mp )  {}
 
     auto  Get( int64_t off, uint64_t len ) const -> mtc::api<const mtc::IByteBuffer> override;
 
     implement_lifetime_control
   };
 
+  class BlocksRepo::Slice final: public mtc::IByteBuffer
+  {
+    implement_lifetime_control
+
+  public:
+    Slice( const char* p, size_t l, const BlocksRepo* o ):
+      bufptr( p ),
+      length( l ),
+      holder( o ) {}
+
+  public:
+    auto  GetPtr() const -> const char* override
+      {  return bufptr;  }
+    auto  GetLen() const -> size_t override
+      {  return length;  }
+    int   SetBuf( const void*, size_t ) override
+      {  throw std::logic_error( "not implemented @" __FILE__ ":" LINE_STRING );  }
+    int   SetLen( size_t ) override
+      {  throw std::logic_error( "not implemented @" __FILE__ ":" LINE_STRING );  }
+
+  protected:
+    const char*                 bufptr;
+    size_t                      length;
+    mtc::api<const BlocksRepo>  holder;
+
+  };
+
+ /*
+  * AdviseMemory( buffer, mode, access )
+  *
+  * Applies the policy access hint to the pages of the mapped buffer, and the huge pages
+  * flag to the mapped or preloaded one. The hints are advisory, so the errors are ignored.
+  */
+  static  void  AdviseMemory( const mtc::IByteBuffer* buffer, Mode mode, Access access )
+  {
+    int   advice = -1;
+
+    if ( buffer == nullptr || buffer->GetLen() == 0 || access == access_normal )
+      return;
+
+    auto  pgsize = uintptr_t(sysconf( _SC_PAGESIZE ));
+    auto  pgbase = uintptr_t(buffer->GetPtr()) & ~(pgsize - 1);
+    auto  length = size_t(uintptr_t(buffer->GetPtr()) + buffer->GetLen() - pgbase);
+
+    if ( mode == memory_mapped )
+      switch ( access & ~huge_pages )
+      {
+        case access_random:     advice = MADV_RANDOM;         break;
+        case access_sequential: advice = MADV_SEQUENTIAL;     break;
+        case access_willneed:   advice = MADV_WILLNEED;       break;
+# if defined( MADV_POPULATE_READ )
+        case access_populate:   advice = MADV_POPULATE_READ;  break;
+# else
+        case access_populate:   advice = MADV_WILLNEED;       break;
+# endif   // MADV_POPULATE_READ
+        default:  break;
+      }
+
+    if ( advice != -1 )
+      (void)madvise( (void*)pgbase, length, advice );
+
+# if defined( MADV_HUGEPAGE )
+    if ( (access & huge_pages) != 0 )
+      (void)madvise( (void*)pgbase, length, MADV_HUGEPAGE );
+# endif   // MADV_HUGEPAGE
+  }
+
+ /*
+  * AdviseFile( path, access )
+  *
+  * Starts reading the file read by pread() to the page cache for willneed and populate
+  * hints; the random and sequential readahead hints belong to the open file description
+  * of the stream and are not applied.
+  */
+  static  void  AdviseFile( const std::string& path, Access access )
+  {
+    auto  hint = access & ~huge_pages;
+    int   hdfile;
+
+    if ( hint != access_willneed && hint != access_populate )
+      return;
+
+    if ( (hdfile = open( path.c_str(), O_RDONLY )) >= 0 )
+    {
+      (void)posix_fadvise( hdfile, 0, 0, POSIX_FADV_WILLNEED );
+      close( hdfile );
+    }
+  }
+
   auto  LoadByteBuffer( const StoragePolicies& policies, Unit unit ) -> mtc::api<const mtc::IByteBuffer>
   {
     auto  policy = policies.GetPolicy( unit );
@@ -107,6 +229,7 @@ namespace posixFS {
     {
       auto  infile = mtc::OpenFileStream( policy->GetFilePath( unit ).c_str(), O_RDONLY,
         mtc::enable_exceptions );
+      auto  loaded = mtc::api<const mtc::IByteBuffer>();
 
     // check the signature
 
@@ -115,11 +238,15 @@ namespace posixFS {
       {
         if ( infile->Size() > (std::numeric_limits<uint32_t>::max)() )
           throw std::invalid_argument( "file too large to be preloaded @" __FILE__ ":" LINE_STRING );
-        return infile->PGet( 0, uint32_t(infile->Size() - 0) ).ptr();
+        loaded = infile->PGet( 0, uint32_t(infile->Size() - 0) ).ptr();
       }
+        else
       if ( policy->mode == memory_mapped )
-        return infile->MemMap( 0, infile->Size() - 0 ).ptr();
-      throw std::invalid_argument( "invalid open mode @" __FILE__ ":" LINE_STRING );
+        loaded = infile->MemMap( 0, infile->Size() - 0 ).ptr();
+      else
+        throw std::invalid_argument( "invalid open mode @" __FILE__ ":" LINE_STRING );
+
+      return AdviseMemory( loaded.ptr(), policy->mode, policy->access ), loaded;
     }
     return nullptr;
   }
@@ -158,6 +285,12 @@ namespace posixFS {
     close( handle );
   }
 
+  Serialized::~Serialized()
+  {
+    if ( compactor.valid() )
+      compactor.wait();
+  }
+
   /*
   * Serialized::Entities()
   *
@@ -195,8 +328,19 @@ namespace posixFS {
     {
       try
       {
-        linkages = new BlocksRepo( OpenFileStream( policies.GetPolicy( Unit::linkages )->GetFilePath(
-          Unit::linkages ).c_str(), O_RDONLY, mtc::enable_exceptions ) );
+        auto  policy = policies.GetPolicy( Unit::linkages );
+        auto  infile = OpenFileStream( policy->GetFilePath( Unit::linkages ).c_str(),
+          O_RDONLY, mtc::enable_exceptions );
+
+      // the linkages too large to be preloaded are read by pread() as file-based ones
+        if ( policy->mode == file_based || infile->Size() == 0
+          || (policy->mode == preloaded && infile->Size() > (std::numeric_limits<uint32_t>::max)()) )
+        {
+          AdviseFile( policy->GetFilePath( Unit::linkages ), policy->access );
+          linkages = new BlocksRepo( infile );
+        }
+          else
+        linkages = new BlocksRepo( LoadByteBuffer( policies, Unit::linkages ) );
       }
       catch ( const mtc::file_error& )  {}
     }
@@ -207,8 +351,26 @@ namespace posixFS {
   {
     if ( packages == nullptr )
     {
-      packages = CreateDumpStore( OpenFileStream( policies.GetPolicy( Unit::packages )->GetFilePath( Unit::packages ).c_str(),
-        O_RDONLY, mtc::disable_exceptions ).ptr() );
+      auto  policy = policies.GetPolicy( Unit::packages );
+
+    // the own and the shared packages files are opened the same way; memory-mapped bundles
+    // are returned as references to the mapping, else read by pread()
+      packages = OpenPackages( policy->GetFilePath( Unit::packages ), [policy]( const std::string& path )
+        {
+          auto  infile = OpenFileStream( path.c_str(), O_RDONLY, mtc::disable_exceptions );
+
+          if ( infile != nullptr && policy->mode == memory_mapped && infile->Size() != 0 )
+          {
+            auto  mapped = infile->MemMap( 0, infile->Size() );
+
+            AdviseMemory( mapped.ptr(), policy->mode, policy->access );
+            return CreateDumpStore( mapped.ptr() );
+          }
+
+          if ( infile != nullptr )
+            AdviseFile( path, policy->access );
+          return CreateDumpStore( infile.ptr() );
+        } );
     }
     return packages;
   }
@@ -220,6 +382,9 @@ namespace posixFS {
 
   void  Serialized::Remove()
   {
+    if ( compactor.valid() )
+      compactor.wait();
+
     entities = nullptr;
     linkages = nullptr;
     contents = nullptr;
@@ -233,6 +398,11 @@ namespace posixFS {
       {
         auto  flpath = policy->GetFilePath( unit );
 
+        if ( unit == Unit::packages )
+        {
+          RemovePackages( flpath );
+        }
+          else
         if ( unit == Unit::revision )
         {
           auto  diread = mtc::directory::Open( (flpath + ".*").c_str(), mtc::directory::attr_file );
@@ -267,7 +437,7 @@ namespace posixFS {
       int   nerror;
 
       if ( fPatch >= 0 )
-        return close( fPatch ), new Patch( CreateOutputStream( sPatch.c_str() ) );
+        return close( fPatch ), new Patch( CreateOutputStream( sPatch.c_str(), 0x8000 ) );
 
       if ( (nerror = errno) != EEXIST )
         throw mtc::file_error( mtc::strprintf( "could not create file '%s', error %d (%s)", sPatch.c_str(), nerror, strerror( nerror ) ) );
@@ -277,13 +447,16 @@ namespace posixFS {
  /*
   * Serialized::SetPatch( IPatch* to )
   *
-  * loads the list of patches, deserializes and calls the interface passed for each record
+  * loads the list of patches, deserializes and calls the interface passed for each record;
+  * if there are several revision files, starts the background compaction
   */
   void  Serialized::SetPatch( IPatch* to )
   {
     auto  policy = policies.GetPolicy( revision );
     auto  diread = mtc::directory();
     auto  afiles = std::vector<std::string>();
+    auto  mapped = std::vector<mtc::api<const mtc::IByteBuffer>>();
+    auto  folded = std::map<std::string_view, std::pair<char, std::string_view>>();
 
     if ( to == nullptr )
       throw std::invalid_argument( "'to' parameter must not be nullptr @" __FILE__ ":" LINE_STRING );
@@ -291,6 +464,9 @@ namespace posixFS {
     if ( policy == nullptr )
       throw std::logic_error( "invalid policy: undefined 'revision' @" __FILE__ ":" LINE_STRING );
 
+    if ( compactor.valid() )
+      compactor.wait();
+
     if ( !(diread = mtc::directory::Open( (policy->GetFilePath( revision ) + ".*").c_str(), mtc::directory::attr_file )).defined() )
       return;
 
@@ -303,9 +479,8 @@ namespace posixFS {
     for ( auto& next: afiles )
     {
       auto  source = mtc::OpenFileStream( next, O_RDONLY, mtc::enable_exceptions );
-      auto  mapped = source->MemMap( 0, source->Size() );
-      auto  bufptr = mapped->GetPtr();
-      auto  bufend = mapped->GetPtr() + mapped->GetLen();
+      auto  bufptr = (mapped.emplace_back( source->MemMap( 0, source->Size() ).ptr() ))->GetPtr();
+      auto  bufend = mapped.back()->GetPtr() + mapped.back()->GetLen();
 
       while ( bufptr != nullptr && bufptr < bufend )
       {
@@ -314,6 +489,7 @@ namespace posixFS {
         const char* valptr;
         size_t      vallen;
         char        opcode;
+        auto*       record = (std::pair<char, std::string_view>*)nullptr;
 
         // get key length
         if ( (keyptr = bufptr = ::FetchFrom( bufptr, keylen )) == nullptr || bufptr + keylen >= bufend )
@@ -322,17 +498,116 @@ namespace posixFS {
         // get patch operation
         bufptr = ::FetchFrom( bufptr + keylen, opcode );
 
-        // check operation type
-        if ( opcode == 'D' )  to->Delete( { keyptr, keylen } );
-          else
-        if ( opcode != 'U' )  throw std::invalid_argument( "unexpected patch record type @" __FILE__ ":" LINE_STRING );
+        // check operation type; the deletion has no value
+        if ( opcode == 'D' )
+        {
+          to->Delete( { keyptr, keylen } );
+          folded[{ keyptr, keylen }] = { opcode, {} };
+          continue;
+        }
+
+        if ( opcode != 'U' )
+          throw std::invalid_argument( "unexpected patch record type @" __FILE__ ":" LINE_STRING );
 
         if ( (valptr = bufptr = ::FetchFrom( bufptr, vallen )) == nullptr || bufptr + vallen > bufend )
           break;
         to->Update( { keyptr, keylen }, valptr, vallen );
           bufptr += vallen;
+
+      // the deletion is sticky for the patch table, so the later updates are not folded
+        if ( (record = &folded[{ keyptr, keylen }])->first != 'D' )
+          *record = { opcode, { valptr, vallen } };
       }
     }
+
+    if ( afiles.size() >= compact_revisions )
+    {
+      compactor = std::async( std::launch::async, CompactPatches, policy->GetFilePath( revision ) + "~",
+        std::move( afiles ), std::move( mapped ), std::move( folded ) );
+    }
+  }
+
+ /*
+  * SyncPath( path )
+  *
+  * Flushes the file or the directory to the disk; returns false on errors.
+  */
+  static  bool  SyncPath( const std::string& path )
+  {
+    auto  handle = open( path.c_str(), O_RDONLY );
+    auto  synced = handle >= 0 && fsync( handle ) == 0;
+
+    if ( handle >= 0 )
+      close( handle );
+
+    return synced;
+  }
+
+ /*
+  * CompactPatches( tmstem, afiles, mapped, folded )
+  *
+  * Writes the last state of each patched entity sorted by the entity id to the temporary
+  * file out of the revision files mask, named uniquely by the tmstem, the process id and
+  * the compaction number and created exclusively, so the compactors of several processes
+  * and index instances never share the file. Then it replaces the newest of folded revision files with
+  * it and removes the others. The records keep the revision file format, so a break at
+  * any step leaves the set of files producing the same patches; the folded file and the
+  * rename are flushed to the disk before the next step.
+  */
+  void  Serialized::CompactPatches(
+    std::string                                                       tmstem,
+    std::vector<std::string>                                          afiles,
+    std::vector<mtc::api<const mtc::IByteBuffer>>                     mapped,
+    std::map<std::string_view, std::pair<char, std::string_view>>     folded )
+  {
+    static std::atomic<unsigned>  ncompact( 0 );
+
+    auto  tmpath = std::string();
+
+    for ( ; ; )
+    {
+      auto  handle = open( (tmpath = tmstem + mtc::strprintf( ".%u.%u", unsigned(getpid()), ++ncompact )).c_str(),
+        O_CREAT + O_RDWR + O_EXCL, 0644 );
+
+      if ( handle >= 0 )
+      {
+        close( handle );
+        break;
+      }
+
+      if ( errno != EEXIST )
+        return;
+    }
+
+    try
+    {
+      {
+        auto  output = mtc::api<IPatch>( new Patch( CreateOutputStream( tmpath.c_str(), 0x8000 ) ) );
+
+        for ( auto& next: folded )
+        {
+          if ( next.second.first == 'D' )
+            output->Delete( next.first );
+          else
+            output->Update( next.first, next.second.second.data(), next.second.second.size() );
+        }
+      }
+
+      if ( !SyncPath( tmpath ) || rename( tmpath.c_str(), afiles.back().c_str() ) != 0 )
+        return (void)remove( tmpath.c_str() );
+
+      if ( !SyncPath( afiles.back().find( '/' ) != std::string::npos ?
+        afiles.back().substr( 0, afiles.back().rfind( '/' ) + 1 ) : "." ) )
+          return;
+
+      for ( afiles.pop_back(); !afiles.empty(); afiles.pop_back() )
+        remove( afiles.back().c_str() );
+    }
+    catch ( ... )
+    {
+      remove( tmpath.c_str() );
+    }
+    (void)mapped;
   }
 
   // Serialized::Patch
@@ -374,9 +649,18 @@ namespace posixFS {
 
   auto  BlocksRepo::Get( int64_t off, uint64_t len ) const -> mtc::api<const mtc::IByteBuffer>
   {
-    return len <= 1024 * 1024 ?
-      fileStream->PGet  ( off, len ).ptr() :
-      fileStream->MemMap( off, len ).ptr();
+    auto  maxlen = wholeBlock != nullptr ? uint64_t(wholeBlock->GetLen()) : fileLength;
+
+    if ( off < 0 || uint64_t(off) > maxlen || len > maxlen - off )
+      throw std::invalid_argument( "block is out of linkages range @" __FILE__ ":" LINE_STRING );
+
+    if ( wholeBlock != nullptr )
+      return new Slice( wholeBlock->GetPtr() + off, len, this );
+
+    if ( len > (std::numeric_limits<uint32_t>::max)() )
+      throw std::invalid_argument( "block is too large to be read @" __FILE__ ":" LINE_STRING );
+
+    return fileStream->PGet( off, uint32_t(len) ).ptr();
   }
 
   auto  OpenSerial( const StoragePolicies& policies ) -> mtc::api<IStorage::ISerialized>
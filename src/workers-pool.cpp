@@ -0,0 +1,128 @@
+# include "workers-pool.hpp"
+# include <algorithm>
+
+namespace structo {
+
+  struct WorkersPool::Batch
+  {
+    const std::function<void( size_t )>&  action;
+    size_t                                count;
+    size_t                                nnext = 0;    // next job to start
+    size_t                                ndone = 0;    // jobs finished
+    std::exception_ptr                    except;
+  };
+
+  // WorkersPool implementation
+
+  WorkersPool::WorkersPool( unsigned nthreads )
+  {
+    for ( unsigned i = 0; i != nthreads; ++i )
+      workers.emplace_back( &WorkersPool::Work, this );
+  }
+
+  WorkersPool::~WorkersPool()
+  {
+    mxLock.lock();
+      isFinal = true;
+    mxLock.unlock();
+
+    cvWork.notify_all();
+
+    for ( auto& next: workers )
+      next.join();
+  }
+
+ /*
+  * The jobs are taken by the index under the lock, so the batch stays alive until
+  * the last started job is finished and counted.
+  */
+  void  WorkersPool::Run( size_t count, const std::function<void( size_t )>& action )
+  {
+    auto  batch = Batch{ action, count };
+    auto  exlock = std::unique_lock<std::mutex>( mxLock );
+
+    if ( count == 0 )
+      return;
+
+    if ( count > 1 )
+    {
+      batches.push_back( &batch );
+      cvWork.notify_all();
+    }
+
+  // the caller thread works too
+    while ( batch.nnext < batch.count )
+    {
+      auto  ijob = batch.nnext++;
+
+      exlock.unlock();
+
+      try
+        {  action( ijob );  }
+      catch ( ... )
+        {
+          exlock.lock();
+          if ( batch.except == nullptr )
+            batch.except = std::current_exception();
+          exlock.unlock();
+        }
+
+      exlock.lock();
+        ++batch.ndone;
+    }
+
+  // wait for the jobs started by the pool
+    while ( batch.ndone != batch.count )
+      cvDone.wait( exlock );
+
+    batches.erase( std::remove( batches.begin(), batches.end(), &batch ), batches.end() );
+
+    if ( batch.except != nullptr )
+      std::rethrow_exception( batch.except );
+  }
+
+  void  WorkersPool::Work()
+  {
+    auto  exlock = std::unique_lock<std::mutex>( mxLock );
+
+    for ( ; ; )
+    {
+      if ( batches.empty() )
+      {
+        if ( isFinal )
+          break;
+        cvWork.wait( exlock );
+        continue;
+      }
+
+    // drop the batches with all the jobs started
+      auto  pbatch = batches.front();
+
+      if ( pbatch->nnext == pbatch->count )
+      {
+        batches.pop_front();
+        continue;
+      }
+
+      auto  ijob = pbatch->nnext++;
+
+      exlock.unlock();
+
+      try
+        {  pbatch->action( ijob );  }
+      catch ( ... )
+        {
+          exlock.lock();
+          if ( pbatch->except == nullptr )
+            pbatch->except = std::current_exception();
+          exlock.unlock();
+        }
+
+      exlock.lock();
+
+      if ( ++pbatch->ndone == pbatch->count )
+        cvDone.notify_all();
+    }
+  }
+
+}
@@ -0,0 +1,47 @@
+# if !defined( __structo_src_workers_pool_hpp__ )
+# define __structo_src_workers_pool_hpp__
+# include <condition_variable>
+# include <functional>
+# include <exception>
+# include <thread>
+# include <vector>
+# include <deque>
+# include <mutex>
+
+namespace structo {
+
+ /*
+  * WorkersPool
+  *
+  * Постоянный пул потоков: Run( count, action ) выполняет count заданий параллельно
+  * на потоках пула и вызывающем потоке и возвращает управление после завершения всех
+  * заданий.
+  *
+  * Первое из исключений, брошенных action(), передаётся вызывающему.
+  */
+  class WorkersPool
+  {
+    struct Batch;
+
+  public:
+    WorkersPool( unsigned );
+   ~WorkersPool();
+
+    void  Run( size_t, const std::function<void( size_t )>& );
+
+  protected:
+    void  Work();
+
+  protected:
+    std::mutex                mxLock;
+    std::condition_variable   cvWork;
+    std::condition_variable   cvDone;
+    std::deque<Batch*>        batches;
+    std::vector<std::thread>  workers;
+    bool                      isFinal = false;
+
+  };
+
+}
+
+# endif   // !__structo_src_workers_pool_hpp__
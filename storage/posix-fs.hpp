@@ -24,11 +24,39 @@ namespace posixFS {
     file_based    = 2
   };
 
+ /*
+  * Codec - сжатие записей пакетов документов (Unit::packages); записи сжимаются,
+  * только если это уменьшает их длину, и читаются независимо от кодека политики.
+  */
+  enum Codec: unsigned
+  {
+    uncompressed  = 0,
+    lz_compressed = 1
+  };
+
+ /*
+  * Access - подсказка ядру о характере доступа к файлу блока индекса: для отображённых
+  * и загруженных блоков применяется madvise(), для читаемых pread() - posix_fadvise().
+  * Флаг huge_pages может быть добавлен к любой подсказке и запрашивает отображение
+  * блока прозрачными большими страницами.
+  */
+  enum Access: unsigned
+  {
+    access_normal     = 0,
+    access_random     = 1,
+    access_sequential = 2,
+    access_willneed   = 3,
+    access_populate   = 4,
+    huge_pages        = 0x100
+  };
+
   struct Policy
   {
     const Unit        unit;
     const Mode        mode;
     const std::string path;
+    const Codec       codec = uncompressed;
+    const Access      access = access_normal;
 
   public:
     auto  GetFilePath( Unit, const char* stamp = nullptr ) const -> std::string;
@@ -66,7 +94,7 @@ namespace posixFS {
 
   public:
     auto  AddPolicy( const Policy& ) -> StoragePolicies&;
-    auto  AddPolicy( Unit, Mode, std::string_view ) -> StoragePolicies&;
+    auto  AddPolicy( Unit, Mode, std::string_view, Codec = uncompressed, Access = access_normal ) -> StoragePolicies&;
     auto  GetPolicy( Unit ) const -> const Policy*;
     static
     auto  GetSuffix( Unit ) -> const char*;
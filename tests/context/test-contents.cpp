@@ -116,5 +116,34 @@ TestItEasy::RegisterFunc  test_contents_processor( []()
           }
       }
     }
+    SECTION( "rich contents builder is reused for the next documents" )
+    {
+      auto  fieldMan = FieldManager();
+      auto  asString = []( const Contents& contents )
+        {
+          auto  output = std::string();
+
+          for ( auto& next: contents.get() )
+            output.append( next.key ).append( next.val ).append( 1, char(next.bid) );
+          return output;
+        };
+      auto  contents = GetRichContents( body.GetLemmas(), body.GetMarkup(), fieldMan );
+      auto  original = asString( contents );
+
+      SECTION( "* the contents kept alive are not affected by the next ones" )
+      {
+        auto  another = GetRichContents( body.GetLemmas(), body.GetMarkup(), fieldMan );
+
+        REQUIRE( asString( another ) == original );
+        REQUIRE( asString( contents ) == original );
+      }
+      SECTION( "* the released contents memory produces the same contents" )
+      {
+        contents = Contents();
+
+        for ( int i = 0; i != 3; ++i )
+          REQUIRE( asString( GetRichContents( body.GetLemmas(), body.GetMarkup(), fieldMan ) ) == original );
+      }
+    }
   }
 } );
@@ -1,4 +1,5 @@
 # include "../../context/processor.hpp"
+# include "../../context/lemmatizer.hpp"
 # include "../../compat.hpp"
 # include <DeliriX/DOM-dump.hpp>
 # include <mtc/test-it-easy.hpp>
@@ -29,6 +30,17 @@ class MockLang: public ILemmatizer
   }
 };
 
+class CountLang: public MockLang
+{
+  int   Lemmatize( IWord* word, unsigned opt, const widechar* pstr, size_t ncch ) override
+  {
+    return ++ncalls, MockLang::Lemmatize( word, opt, pstr, ncch );
+  }
+
+public:
+  size_t  ncalls = 0;
+};
+
 class MockFields: public FieldHandler
 {
   auto  Add( const std::string_view& ) -> FieldOptions* override
@@ -150,7 +162,73 @@ TestItEasy::RegisterFunc  test_processor( []()
                 REQUIRE( (next.front().get_idl() == 0x7 || next.front().get_idl() == 0xfeU) );
             }
         }
+        SECTION( "documents may be processed on the pool of threads" )
+        {
+          auto  texts = std::vector<DeliriX::Text>( 100 );
+          auto  sizes = std::vector<std::pair<size_t, size_t>>( texts.size() );
+
+          for ( size_t i = 0; i != texts.size(); ++i )
+            CopyUtf16( &texts[i], DeliriX::Text{ ("строка номер " + std::to_string( i ) + " простого текста").c_str() } );
+
+          if ( REQUIRE_NOTHROW( txProc.MakeImages( texts.size(),
+            [&]( size_t n ) -> const DeliriX::ITextView&  {  return texts[n];  },
+            [&]( size_t n, const context::Image& image )
+              {
+                sizes[n] = { image.GetTokens().size(), image.GetLemmas().size() };
+              }, &mockFd, 4 ) ) )
+          {
+            for ( size_t i = 0; i != texts.size(); ++i )
+            {
+              auto  image = txProc.MakeImage( texts[i], &mockFd );
+
+              REQUIRE( sizes[i].first == image.GetTokens().size() );
+              REQUIRE( sizes[i].second == image.GetLemmas().size() );
+            }
+          }
+          SECTION( "the first exception stops the batch" )
+          {
+            REQUIRE_EXCEPTION( txProc.MakeImages( texts.size(),
+              [&]( size_t n ) -> const DeliriX::ITextView&  {  return texts[n];  },
+              [&]( size_t n, const context::Image& )
+                {
+                  if ( n == 10 )
+                    throw std::runtime_error( "test" );
+                }, nullptr, 4 ), std::runtime_error );
+          }
+        }
       }
     }
   }
+  TEST_CASE( "context/lemma-cache" )
+  {
+    CountLang           countLg;
+    context::Processor  txProc;
+
+    txProc.AddModule( 0x7, &countLg );
+
+    SECTION( "repeated words are lemmatized by the module once" )
+    {
+      auto  first = txProc.Lemmatize( codepages::mbcstowide( codepages::codepage_utf8, "строка" ) );
+      auto  again = txProc.Lemmatize( codepages::mbcstowide( codepages::codepage_utf8, "строка" ) );
+
+      if ( REQUIRE( first.size() == again.size() ) && REQUIRE( first.size() != 0 ) )
+      {
+        REQUIRE( std::string_view( first.front().data(), first.front().size() )
+              == std::string_view( again.front().data(), again.front().size() ) );
+      }
+      REQUIRE( countLg.ncalls == 1 );
+
+      SECTION( "other words are passed to the module" )
+      {
+        txProc.Lemmatize( codepages::mbcstowide( codepages::codepage_utf8, "текст" ) );
+        REQUIRE( countLg.ncalls == 2 );
+      }
+    }
+    SECTION( "cached modules are not wrapped twice" )
+    {
+      auto  cached = context::CacheLemmatizer( &countLg );
+
+      REQUIRE( context::CacheLemmatizer( cached ).ptr() == cached.ptr() );
+    }
+  }
 } );
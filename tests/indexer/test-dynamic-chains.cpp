@@ -56,6 +56,38 @@ TestItEasy::RegisterFunc  dynamic_chains( []()
 
         chains->StopIt();
       }
+      SECTION( "BlockChains keep all the keys while the hash table grows" )
+      {
+        auto  chains = dynamic::BlockChains<>();
+        auto  nfound = 0;
+
+        for ( auto i = 0; i != 300000; ++i )
+          chains.Insert( mtc::strprintf( "key-%d", i ), 1 + i % 7, {}, -1 );
+
+        for ( auto i = 0; i != 300000; ++i )
+          nfound += chains.Lookup( mtc::strprintf( "key-%d", i ) ) != nullptr;
+
+        REQUIRE( nfound == 300000 );
+        REQUIRE( chains.Lookup( "key--1" ) == nullptr );
+        REQUIRE( chains.Verify() );
+      }
+      SECTION( "BlockChains do not block the writers while the keys are listed" )
+      {
+        auto  chains = dynamic::BlockChains<>();
+
+        chains.Insert( "key-0", 1, {}, -1 );
+
+        {
+          auto  lister = chains.ListKeys( "" );
+
+          for ( auto i = 1; i != 3 * dynamic::ring_buffer_size; ++i )
+            chains.Insert( mtc::strprintf( "key-%d", i ), 1, {}, -1 );
+        }
+
+        chains.StopIt();
+
+        REQUIRE( chains.KeyCount() == 3 * dynamic::ring_buffer_size );
+      }
       SECTION( "BlockChains provide correct inserion order in multithreaded environments" )
       {
         auto  chains = dynamic::BlockChains<>();
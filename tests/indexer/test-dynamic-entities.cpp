@@ -201,6 +201,30 @@ TestItEasy::RegisterFunc  dynamic_entities( []()
           if ( REQUIRE( entity != nullptr ) )
             REQUIRE( entity->GetId() != "ccc" );
       }
+      SECTION( "entities table without size limit grows on demand" )
+      {
+        auto  entity_table = dynamic::EntityTable<>( 0, nullptr, nullptr );
+        auto  nfound = 0;
+
+        for ( auto i = 0; i != 100000; ++i )
+          entity_table.SetEntity( mtc::strprintf( ENTITY_ID_PREFIX "%d", i % 60000 ) );
+
+        REQUIRE( entity_table.GetEntityCount() == 100000 );
+
+        for ( auto i = 0; i != 60000; ++i )
+        {
+          auto  entity = entity_table.GetEntity( mtc::strprintf( ENTITY_ID_PREFIX "%d", i ) );
+
+          if ( entity != nullptr && entity->GetIndex() == uint32_t(i < 40000 ? 60001 + i : 1 + i) )
+            ++nfound;
+        }
+
+        REQUIRE( nfound == 60000 );
+        REQUIRE( entity_table.IsDeleted( 1 ) );
+        REQUIRE( !entity_table.IsDeleted( 40001 ) );
+        REQUIRE( entity_table.GetEntity( 99999U ) != nullptr );
+        REQUIRE( entity_table.GetEntity( 100001U ) == nullptr );
+      }
     }
   } );
 
@@ -121,6 +121,42 @@ TestItEasy::RegisterFunc  index_layers( []()
               }
             }
           }
+          SECTION( "with keys cache, key blocks are found the same way" )
+          {
+            auto  entities = mtc::api<IContentsIndex::IEntities>();
+
+            flakes.useKeysCache();
+
+            for ( auto i = 0; i != 2; ++i )
+            {
+              if ( REQUIRE_NOTHROW( entities = flakes.getKeyBlock( "ddd" ) ) && REQUIRE( entities != nullptr ) )
+              {
+                REQUIRE( entities->Find( 1 ).uEntity == 2 );
+                REQUIRE( entities->Find( 3 ).uEntity == 3 );
+                REQUIRE( entities->Find( 4 ).uEntity == 4 );
+                REQUIRE( entities->Find( 5 ).uEntity == uint32_t(-1) );
+              }
+              if ( REQUIRE_NOTHROW( entities = flakes.getKeyBlock( "hhh" ) ) && REQUIRE( entities != nullptr ) )
+                REQUIRE( entities->Find( 1 ).uEntity == 6 );
+              REQUIRE( flakes.getKeyBlock( "zzz" ) == nullptr );
+            }
+            SECTION( "after the layers change, the keys of new layers are found" )
+            {
+              REQUIRE_NOTHROW( flakes.addContents( CreateStaticIndex( {
+                { "i7", {
+                  { "aaa", "aaa" },
+                  { "zzz", "zzz" } } }
+                } ) ) );
+
+              if ( REQUIRE_NOTHROW( entities = flakes.getKeyBlock( "aaa" ) ) && REQUIRE( entities != nullptr ) )
+              {
+                REQUIRE( entities->Find( 1 ).uEntity == 1 );
+                REQUIRE( entities->Find( 2 ).uEntity == 7 );
+              }
+              if ( REQUIRE_NOTHROW( entities = flakes.getKeyBlock( "zzz" ) ) && REQUIRE( entities != nullptr ) )
+                REQUIRE( entities->Find( 1 ).uEntity == 7 );
+            }
+          }
           SECTION( "entity may be deleted" )
           {
             bool  deleted;
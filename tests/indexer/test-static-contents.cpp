@@ -234,5 +234,50 @@ TestItEasy::RegisterFunc  static_contents( []()
           }
         }
       }
+      SECTION( "long key blocks of the committed dynamic index are navigable" )
+      {
+        auto  contents = mtc::api<IContentsIndex>();
+        auto  entities = mtc::api<IContentsIndex::IEntities>();
+        auto  entRef = IContentsIndex::IEntities::Reference();
+
+        REQUIRE_NOTHROW( contents = dynamic::Index()
+          .Set( storage::posixFS::CreateSink( storage::posixFS::StoragePolicies::Open(
+            GetTmpPath() + "k3" ) ) ).Create() );
+
+        for ( auto i = 1; i <= 3000; ++i )
+        {
+          auto  value = "value-" + std::to_string( i );
+
+          contents->SetEntity( "entity-" + std::to_string( i ), { { "all", value } } );
+        }
+
+        if ( REQUIRE_NOTHROW( contents = static_::Index().Create( contents->Commit() ) )
+          && REQUIRE( contents != nullptr )
+          && REQUIRE_NOTHROW( entities = contents->GetKeyBlock( "all" ) ) && REQUIRE( entities != nullptr ) )
+        {
+          if ( REQUIRE_NOTHROW( entRef = entities->Find( 2500 ) ) && REQUIRE( entRef.uEntity == 2500 ) )
+            REQUIRE( std::string( entRef.details.data(), entRef.details.size() ) == "value-2500" );
+
+          SECTION( "* bounded copies start from the navigation points" )
+          {
+            auto  ncount = 0;
+            auto  uFirst = uint32_t(-1);
+            auto  uFinal = uint32_t(-1);
+
+            if ( REQUIRE_NOTHROW( entities = entities->Copy( { 1000, 1100 } ) ) && REQUIRE( entities != nullptr ) )
+            {
+              for ( entRef = entities->Find( 0 ); entRef.uEntity != uint32_t(-1); entRef = entities->Find( entRef.uEntity + 1 ), ++ncount )
+              {
+                if ( uFirst == uint32_t(-1) )
+                  uFirst = entRef.uEntity;
+                uFinal = entRef.uEntity;
+              }
+              REQUIRE( uFirst == 1000 );
+              REQUIRE( uFinal == 1099 );
+              REQUIRE( ncount == 100 );
+            }
+          }
+        }
+      }
     }
   } );
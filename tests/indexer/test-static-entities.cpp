@@ -84,6 +84,24 @@ TestItEasy::RegisterFunc  static_entities( []()
           }
         }
       }
+      SECTION( "entities table may be created from the image without navigation tail" )
+      {
+        auto  footer = EntitiesImage::Footer();
+
+        if ( REQUIRE( EntitiesImage::GetFooter( { serialized.data(), serialized.size() }, footer ) ) )
+        {
+          static_::EntityTable<>  entities( { serialized.data(), footer.recordsLen }, nullptr, nullptr );
+
+          REQUIRE( entities.GetEntityCount() == 3 );
+
+          if ( REQUIRE_NOTHROW( entities.GetEntity( "bbb" ) ) && REQUIRE( entities.GetEntity( "bbb" ) != nullptr ) )
+            REQUIRE( entities.GetEntity( "bbb" )->GetIndex() == 2 );
+          if ( REQUIRE_NOTHROW( entities.GetEntity( 3 ) ) && REQUIRE( entities.GetEntity( 3 ) != nullptr ) )
+            REQUIRE( entities.GetEntity( 3 )->GetId() == "ccc" );
+          if ( REQUIRE_NOTHROW( entities.GetEntity( "q" ) ) )
+            REQUIRE( entities.GetEntity( "q" ) == nullptr );
+        }
+      }
       SECTION( "entities table may be created with custom allocator also" )
       {
         mtc::Arena  memArena;
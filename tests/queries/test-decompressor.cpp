@@ -0,0 +1,98 @@
+# include "../../src/queries/decompressor.hpp"
+# include <mtc/test-it-easy.hpp>
+# include <vector>
+# include <string>
+
+using namespace structo::queries;
+
+auto  PackVarints( const std::vector<unsigned>& values ) -> std::string
+{
+  auto  output = std::string();
+
+  for ( auto value: values )
+  {
+    for ( ; value >= 0x80; value >>= 7 )
+      output.push_back( char(0x80 | (value & 0x7f)) );
+    output.push_back( char(value) );
+  }
+  return output;
+}
+
+auto  FetchAll( const std::string& source ) -> std::vector<unsigned>
+{
+  auto      output = std::vector<unsigned>();
+  auto      reader = BulkFetcher( source.data(), source.data() + source.size() );
+  unsigned  nvalue;
+
+  while ( reader.Get( nvalue ) )
+    output.push_back( nvalue );
+
+  return output;
+}
+
+TestItEasy::RegisterFunc  test_decompressor( []()
+  {
+    TEST_CASE( "queries/decompressor" )
+    {
+      SECTION( "FetchBulk decodes varint sequences" )
+      {
+        SECTION( "* empty source produces no values" )
+        {
+          REQUIRE( FetchAll( "" ).empty() );
+        }
+        SECTION( "* long runs of single-byte values are decoded" )
+        {
+          auto  values = std::vector<unsigned>();
+
+          for ( unsigned i = 0; i != 1000; ++i )
+            values.push_back( i % 0x80 );
+
+          REQUIRE( FetchAll( PackVarints( values ) ) == values );
+        }
+        SECTION( "* mixed-length values are decoded" )
+        {
+          auto  values = std::vector<unsigned>();
+
+          for ( unsigned i = 0; i != 1000; ++i )
+            values.push_back( i % 7 == 0 ? 0xffffffff >> (i % 29) : i % 0x7f );
+
+          REQUIRE( FetchAll( PackVarints( values ) ) == values );
+        }
+        SECTION( "* output length limit is respected" )
+        {
+          auto        source = PackVarints( std::vector<unsigned>( 100, 1 ) );
+          auto        srcptr = source.data();
+          unsigned    output[40];
+
+          REQUIRE( FetchBulk( srcptr, source.data() + source.size(), output, 40 ) == 40 );
+          REQUIRE( srcptr == source.data() + 40 );
+        }
+      }
+      SECTION( "UnpackWordPos restores positions from deltas" )
+      {
+        auto      source = PackVarints( { 3, 0, 5, 1 } );
+        unsigned  output[0x10];
+
+        SECTION( "* without limits all the positions are unpacked" )
+        {
+          if ( REQUIRE( UnpackWordPos( output, source, {} ) == 4 ) )
+          {
+            REQUIRE( output[0] == 3 );
+            REQUIRE( output[1] == 4 );
+            REQUIRE( output[2] == 10 );
+            REQUIRE( output[3] == 12 );
+          }
+        }
+        SECTION( "* with limits the positions are filtered" )
+        {
+          if ( REQUIRE( UnpackWordPos( output, source, { 4, 9 } ) == 1 ) )
+            REQUIRE( output[0] == 4 );
+        }
+        SECTION( "* the upper limit is inclusive" )
+        {
+          if ( REQUIRE( UnpackWordPos( output, source, { 0, 10 } ) == 3 ) )
+            REQUIRE( output[2] == 10 );
+        }
+      }
+    }
+  } );
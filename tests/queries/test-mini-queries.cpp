@@ -1,6 +1,7 @@
 # include "../../context/x-contents.hpp"
 # include "../../context/processor.hpp"
 # include "../../queries/builder.hpp"
+# include "../../rankers.hpp"
 # include "../../src/queries/field-set.hpp"
 # include "../../indexer/dynamic-contents.hpp"
 # include <DeliriX/DOM-dump.hpp>
@@ -22,7 +23,8 @@ static  auto  MakeStats( const std::initializer_list<std::pair<const char*, doub
 
 static  context::FieldManager fieldMan;
 
-auto  CreateMiniIndex( const context::Processor& lp, const std::initializer_list<DeliriX::Text>& docs ) -> mtc::api<IContentsIndex>
+template <class Docs>
+auto  CreateMiniIndex( const context::Processor& lp, const Docs& docs ) -> mtc::api<IContentsIndex>
 {
   auto  ct = indexer::dynamic::Index().Create();
   auto  id = 0;
@@ -43,6 +45,11 @@ auto  CreateMiniIndex( const context::Processor& lp, const std::initializer_list
   return ct;
 }
 
+auto  CreateMiniIndex( const context::Processor& lp, const std::initializer_list<DeliriX::Text>& docs ) -> mtc::api<IContentsIndex>
+{
+  return CreateMiniIndex<std::initializer_list<DeliriX::Text>>( lp, docs );
+}
+
 TestItEasy::RegisterFunc  test_mini_queries( []()
 {
   TEST_CASE( "queries/mini" )
@@ -215,5 +222,101 @@ TestItEasy::RegisterFunc  test_mini_queries( []()
         }
       }
     }
+    SECTION( "mini query may be evaluated as top-k BM25 selection" )
+    {
+      auto  mkQuery = [&]()
+        {
+          return queries::BuildMiniQuery( xx, lp, mtc::zmap{
+            { "||", mtc::array_zval{ "городской", "фонарь" } } }, {} );
+        };
+
+      SECTION( "* full selection returns all the entities ordered by weight" )
+      {
+        auto  ranked = rankers::BM25TopK( mkQuery(), 10 );
+
+        if ( REQUIRE( ranked.size() == 3 ) )
+        {
+          REQUIRE( ranked[0].weight >= ranked[1].weight );
+          REQUIRE( ranked[1].weight >= ranked[2].weight );
+        }
+      }
+      SECTION( "* pruned selection returns the same best entities" )
+      {
+        auto  ranked = rankers::BM25TopK( mkQuery(), 10 );
+        auto  topOne = rankers::BM25TopK( mkQuery(), 1 );
+
+        if ( REQUIRE( topOne.size() == 1 ) && REQUIRE( ranked.size() != 0 ) )
+          REQUIRE( !(topOne.front().weight < ranked.front().weight) );
+      }
+      SECTION( "* sharded parallel selection returns the same entities" )
+      {
+        auto  serial = rankers::BM25TopK( mkQuery(), 10 );
+        auto  shards = rankers::BM25TopK( mkQuery(), 10, 4 );
+
+        if ( REQUIRE( shards.size() == serial.size() ) )
+          for ( size_t i = 0; i != shards.size(); ++i )
+            REQUIRE( shards[i].weight == serial[i].weight );
+      }
+      SECTION( "* the weight estimate is not less than the real weight" )
+      {
+        auto  pquery = mkQuery();
+        auto  pruned = dynamic_cast<queries::IPrunedQuery*>( pquery.ptr() );
+
+        if ( REQUIRE( pruned != nullptr ) )
+        {
+          for ( auto& next: rankers::BM25TopK( mkQuery(), 10 ) )
+            REQUIRE( next.weight <= pruned->MaxWeight() );
+        }
+      }
+      SECTION( "* the threshold of the query is restored after the selection" )
+      {
+        auto  pquery = mkQuery();
+        auto  pruned = dynamic_cast<queries::IPrunedQuery*>( pquery.ptr() );
+
+        if ( REQUIRE( pruned != nullptr ) )
+        {
+          rankers::BM25TopK( pquery, 1 );
+          REQUIRE( pruned->GetMinWeight() == 0.0 );
+        }
+      }
+      SECTION( "* long entities not reaching the threshold are skipped" )
+      {
+        auto  texts = std::vector<DeliriX::Text>( 33 );
+        auto  filler = std::string();
+
+        for ( int i = 0; i != 30; ++i )
+          filler += " слово";
+
+        CopyUtf16( &texts[0], DeliriX::Text{ "городской фонарь" } );
+
+        for ( size_t i = 1; i != texts.size(); ++i )
+          CopyUtf16( &texts[i], DeliriX::Text{ ("городской фонарь" + filler).c_str() } );
+
+        auto  dx = CreateMiniIndex( lp, texts );
+        auto  mq = [&]()
+          {
+            return queries::BuildMiniQuery( dx, lp, mtc::zmap{
+              { "||", mtc::array_zval{ "городской", "фонарь" } } }, {} );
+          };
+        auto  ranked = rankers::BM25TopK( mq(), 1 );
+        auto  pquery = mq();
+        auto  pruned = dynamic_cast<queries::IPrunedQuery*>( pquery.ptr() );
+
+        if ( REQUIRE( ranked.size() == 1 ) && REQUIRE( pruned != nullptr ) )
+        {
+          auto  nfound = 0U;
+
+          REQUIRE( ranked.front().entity == 1U );
+
+        // all the entities match both the words, but only the short one may reach the threshold
+          pruned->SetMinWeight( ranked.front().weight / 2 );
+
+          for ( auto docid = pquery->SearchDoc( 1 ); docid != uint32_t(-1); docid = pquery->SearchDoc( docid + 1 ) )
+            ++nfound;
+
+          REQUIRE( nfound == 1U );
+        }
+      }
+    }
   }
 } );
@@ -1,14 +1,29 @@
 # include "../../storage/posix-fs.hpp"
+# include "../../src/storage/posix-fs-dump-store.hpp"
 # include "../toolbox/tmppath.h"
 # include "../toolbox/dirtool.h"
 # include <mtc/test-it-easy.hpp>
+# include <mtc/serialize.h>
 # include <mtc/fileStream.h>
 # include <mtc/exceptions.h>
 # include <mtc/directory.h>
+# include <cstdio>
 # include <thread>
 
 using namespace structo;
 
+struct PatchRecorder: public IStorage::ISerialized::IPatch
+{
+  std::vector<std::string>  records;
+
+  void  Delete( EntityId id ) override
+    {  records.push_back( "D:" + std::string( id ) );  }
+  void  Update( EntityId id, const void* data, size_t size ) override
+    {  records.push_back( "U:" + std::string( id ) + "=" + std::string( (const char*)data, size ) );  }
+
+  implement_lifetime_stub
+};
+
 TestItEasy::RegisterFunc  storage_fs( []()
   {
     TEST_CASE( "storage/filesystem-based" )
@@ -65,5 +80,467 @@ TestItEasy::RegisterFunc  storage_fs( []()
           }
         }
       }
+      SECTION( "serialized blocks are read from the mapped linkages" )
+      {
+        auto  policies = storage::posixFS::StoragePolicies( {
+          { storage::posixFS::Unit( storage::posixFS::linkages | storage::posixFS::entities
+            | storage::posixFS::contents | storage::posixFS::bulletin ), storage::posixFS::memory_mapped, GetTmpPath() + "k3" },
+          { storage::posixFS::packages, storage::posixFS::file_based, GetTmpPath() + "k3" } } );
+        auto  storageSink = mtc::api<IStorage::IIndexStore>();
+        auto  serialized = mtc::api<IStorage::ISerialized>();
+        auto  blockList = std::vector<std::pair<int64_t, uint64_t>>();
+        auto  strValues = std::vector<std::string>();
+        auto  blockSize = int64_t(0);
+
+        RemoveFiles( GetTmpPath() + "k3.*" );
+
+        REQUIRE_NOTHROW( storageSink = storage::posixFS::CreateSink( policies ) );
+
+        for ( int i = 0; i != 100; ++i )
+        {
+          strValues.push_back( "block #" + std::to_string( i ) );
+
+          blockList.push_back( { blockSize, strValues.back().size() } );
+            blockSize += strValues.back().size();
+          storageSink->Linkages()->Put( strValues.back().data(), strValues.back().size() );
+        }
+
+        if ( REQUIRE_NOTHROW( serialized = storageSink->Commit() ) && REQUIRE( serialized != nullptr ) )
+        {
+          SECTION( "* linkages" )
+          {
+            for ( size_t i = 0; i != blockList.size(); ++i )
+            {
+              auto  block = serialized->Linkages()->Get( blockList[i].first, blockList[i].second );
+
+              if ( REQUIRE( block != nullptr ) )
+                REQUIRE( std::string( block->GetPtr(), block->GetLen() ) == strValues[i] );
+            }
+          }
+          SECTION( "* mapped linkages are sliced, out of range blocks are rejected" )
+          {
+            auto  block = mtc::api<const mtc::IByteBuffer>();
+
+            if ( REQUIRE_NOTHROW( block = serialized->Linkages()->Get( blockList[1].first, blockList[1].second ) )
+              && REQUIRE( block != nullptr ) )
+            {
+              REQUIRE( std::string( block->GetPtr(), block->GetLen() ) == strValues[1] );
+            }
+            REQUIRE_EXCEPTION( serialized->Linkages()->Get( blockSize, 1 ), std::invalid_argument );
+          }
+          SECTION( "* file-based linkages are read, out of range blocks are rejected" )
+          {
+            auto  fileBased = mtc::api<IStorage::ISerialized>();
+            auto  block = mtc::api<const mtc::IByteBuffer>();
+
+            REQUIRE_NOTHROW( fileBased = storage::posixFS::OpenSerial( storage::posixFS::StoragePolicies( {
+              { storage::posixFS::Unit( storage::posixFS::entities | storage::posixFS::contents
+                | storage::posixFS::bulletin ), storage::posixFS::memory_mapped, GetTmpPath() + "k3" },
+              { storage::posixFS::Unit( storage::posixFS::linkages | storage::posixFS::packages ),
+                storage::posixFS::file_based, GetTmpPath() + "k3" } } ) ) );
+
+            if ( REQUIRE( fileBased != nullptr )
+              && REQUIRE_NOTHROW( block = fileBased->Linkages()->Get( blockList[1].first, blockList[1].second ) )
+              && REQUIRE( block != nullptr ) )
+            {
+              REQUIRE( std::string( block->GetPtr(), block->GetLen() ) == strValues[1] );
+            }
+            REQUIRE_EXCEPTION( fileBased->Linkages()->Get( -1, 1 ), std::invalid_argument );
+            REQUIRE_EXCEPTION( fileBased->Linkages()->Get( blockSize - 1, 2 ), std::invalid_argument );
+            REQUIRE_EXCEPTION( fileBased->Linkages()->Get( 0, uint64_t(-1) ), std::invalid_argument );
+          }
+        }
+        serialized = nullptr;
+        storageSink = nullptr;
+
+        RemoveFiles( GetTmpPath() + "k3.*" );
+      }
+      SECTION( "bundles may be compressed by the packages policy codec" )
+      {
+        auto  policies = storage::posixFS::StoragePolicies()
+          .AddPolicy( storage::posixFS::Unit( storage::posixFS::linkages | storage::posixFS::entities
+            | storage::posixFS::contents | storage::posixFS::bulletin ), storage::posixFS::memory_mapped, GetTmpPath() + "k4" )
+          .AddPolicy( storage::posixFS::packages, storage::posixFS::memory_mapped, GetTmpPath() + "k4", storage::posixFS::lz_compressed );
+        auto  storageSink = mtc::api<IStorage::IIndexStore>();
+        auto  serialized = mtc::api<IStorage::ISerialized>();
+        auto  pointList = std::vector<int64_t>();
+        auto  strValues = std::vector<std::string>();
+
+        RemoveFiles( GetTmpPath() + "k4.*" );
+
+        REQUIRE_NOTHROW( storageSink = storage::posixFS::CreateSink( policies ) );
+
+        for ( int i = 0; i != 100; ++i )
+        {
+          auto  bundle = std::string();
+
+          for ( int j = 0; j != i * 10; ++j )
+            bundle += "compressible bundle #" + std::to_string( i ) + " ";
+
+          strValues.push_back( bundle );
+          pointList.push_back( storageSink->Packages()->Put( bundle.data(), bundle.size() ) );
+        }
+
+        if ( REQUIRE_NOTHROW( serialized = storageSink->Commit() ) && REQUIRE( serialized != nullptr ) )
+        {
+          SECTION( "* the compressed bundles are restored, the empty one too" )
+          {
+            for ( size_t i = 0; i != strValues.size(); ++i )
+            {
+              auto  bundle = serialized->Packages()->Get( pointList[i] );
+
+              if ( REQUIRE( bundle != nullptr ) )
+                REQUIRE( std::string( bundle->GetPtr(), bundle->GetLen() ) == strValues[i] );
+            }
+          }
+          SECTION( "* the packages are stored shorter than the bundles" )
+          {
+            auto  length = size_t(0);
+
+            for ( auto& next: strValues )
+              length += next.size();
+
+            REQUIRE( pointList.back() < int64_t(length / 4) );
+          }
+        }
+        serialized = nullptr;
+        storageSink = nullptr;
+
+        RemoveFiles( GetTmpPath() + "k4.*" );
+      }
+      SECTION( "bundles may be stored by several threads" )
+      {
+        auto  storageSink = mtc::api<IStorage::IIndexStore>();
+        auto  serialized = mtc::api<IStorage::ISerialized>();
+        auto  pointList = std::vector<int64_t>( 400 );
+        auto  threadSet = std::vector<std::thread>();
+
+        RemoveFiles( GetTmpPath() + "k5.*" );
+
+        REQUIRE_NOTHROW( storageSink = storage::posixFS::CreateSink( storage::posixFS::StoragePolicies::Open( GetTmpPath() + "k5" ) ) );
+
+        for ( size_t t = 0; t != 4; ++t )
+          threadSet.emplace_back( [&, t]()
+            {
+              for ( auto i = t; i < pointList.size(); i += 4 )
+              {
+                auto  bundle = "bundle #" + std::to_string( i );
+
+                pointList[i] = storageSink->Packages()->Put( bundle.data(), bundle.size() );
+              }
+            } );
+
+        for ( auto& next: threadSet )
+          next.join();
+
+        if ( REQUIRE_NOTHROW( serialized = storageSink->Commit() ) && REQUIRE( serialized != nullptr ) )
+        {
+          auto  nvalid = size_t(0);
+
+          for ( size_t i = 0; i != pointList.size(); ++i )
+          {
+            auto  bundle = serialized->Packages()->Get( pointList[i] );
+
+            if ( bundle != nullptr && std::string( bundle->GetPtr(), bundle->GetLen() ) == "bundle #" + std::to_string( i ) )
+              ++nvalid;
+          }
+          REQUIRE( nvalid == pointList.size() );
+        }
+        serialized = nullptr;
+        storageSink = nullptr;
+
+        RemoveFiles( GetTmpPath() + "k5.*" );
+      }
+      SECTION( "stored bundle records may be copied to another repository" )
+      {
+        auto  sourcePolicies = storage::posixFS::StoragePolicies()
+          .AddPolicy( storage::posixFS::Unit( storage::posixFS::linkages | storage::posixFS::entities
+            | storage::posixFS::contents | storage::posixFS::bulletin ), storage::posixFS::memory_mapped, GetTmpPath() + "k6" )
+          .AddPolicy( storage::posixFS::packages, storage::posixFS::memory_mapped, GetTmpPath() + "k6", storage::posixFS::lz_compressed );
+        auto  sourceSink = mtc::api<IStorage::IIndexStore>();
+        auto  targetSink = mtc::api<IStorage::IIndexStore>();
+        auto  serialized = mtc::api<IStorage::ISerialized>();
+        auto  pointList = std::vector<int64_t>();
+        auto  strValues = std::vector<std::string>();
+
+        RemoveFiles( GetTmpPath() + "k6.*" );
+        RemoveFiles( GetTmpPath() + "k7.*" );
+
+        REQUIRE_NOTHROW( sourceSink = storage::posixFS::CreateSink( sourcePolicies ) );
+
+        for ( int i = 0; i != 100; ++i )
+        {
+          strValues.push_back( std::string( i * 10, 'a' + i % 26 ) );
+          pointList.push_back( sourceSink->Packages()->Put( strValues.back().data(), strValues.back().size() ) );
+        }
+
+        if ( REQUIRE_NOTHROW( serialized = sourceSink->Commit() ) && REQUIRE( serialized != nullptr )
+          && REQUIRE_NOTHROW( targetSink = storage::posixFS::CreateSink( storage::posixFS::StoragePolicies::Open( GetTmpPath() + "k7" ) ) ) )
+        {
+          auto  copyList = std::vector<int64_t>();
+
+          for ( auto& next: pointList )
+            copyList.push_back( targetSink->Packages()->Copy( *serialized->Packages().ptr(), next ) );
+
+          SECTION( "* the records keep the stored compressed form" )
+            {  REQUIRE( copyList.back() == pointList.back() );  }
+          SECTION( "* copying a missing record returns -1" )
+            {  REQUIRE( targetSink->Packages()->Copy( *serialized->Packages().ptr(), 1 << 30 ) == -1 );  }
+          SECTION( "* the copied records are read back" )
+          {
+            auto  target = targetSink->Commit();
+
+            for ( size_t i = 0; i != strValues.size(); ++i )
+            {
+              auto  bundle = target->Packages()->Get( copyList[i] );
+
+              if ( REQUIRE( bundle != nullptr ) )
+                REQUIRE( std::string( bundle->GetPtr(), bundle->GetLen() ) == strValues[i] );
+            }
+          }
+        }
+        serialized = nullptr;
+        sourceSink = nullptr;
+        targetSink = nullptr;
+
+        RemoveFiles( GetTmpPath() + "k6.*" );
+        RemoveFiles( GetTmpPath() + "k7.*" );
+      }
+      SECTION( "large bundle files are shared by the repositories the records are copied to" )
+      {
+        auto  sourceSink = mtc::api<IStorage::IIndexStore>();
+        auto  targetSink = mtc::api<IStorage::IIndexStore>();
+        auto  serialized = mtc::api<IStorage::ISerialized>();
+        auto  pointList = std::vector<int64_t>();
+        auto  strValues = std::vector<std::string>();
+
+        RemoveFiles( GetTmpPath() + "k12.*" );
+        RemoveFiles( GetTmpPath() + "k13.*" );
+
+        REQUIRE_NOTHROW( sourceSink = storage::posixFS::CreateSink( storage::posixFS::StoragePolicies::Open( GetTmpPath() + "k12" ) ) );
+
+        for ( int i = 0; i != 300; ++i )
+        {
+          strValues.push_back( std::string( 4000, 'a' + i % 26 ) + std::to_string( i ) );
+          pointList.push_back( sourceSink->Packages()->Put( strValues.back().data(), strValues.back().size() ) );
+        }
+
+        if ( REQUIRE_NOTHROW( serialized = sourceSink->Commit() ) && REQUIRE( serialized != nullptr )
+          && REQUIRE_NOTHROW( targetSink = storage::posixFS::CreateSink( storage::posixFS::StoragePolicies::Open( GetTmpPath() + "k13" ) ) ) )
+        {
+          auto  copyList = std::vector<int64_t>();
+
+          for ( auto& next: pointList )
+            copyList.push_back( targetSink->Packages()->Copy( *serialized->Packages().ptr(), next ) );
+
+          SECTION( "* the records refer the shared source file" )
+          {
+            REQUIRE( copyList.front() != pointList.front() );
+            REQUIRE( SearchFiles( GetTmpPath() + "k13.packages.1" ) );
+          }
+          SECTION( "* the shared records are read after the source is removed" )
+          {
+            auto  target = targetSink->Commit();
+
+            serialized->Remove();
+            serialized = nullptr;
+
+            for ( size_t i = 0; i != strValues.size(); ++i )
+            {
+              auto  bundle = target->Packages()->Get( copyList[i] );
+
+              if ( REQUIRE( bundle != nullptr ) )
+                REQUIRE( std::string( bundle->GetPtr(), bundle->GetLen() ) == strValues[i] );
+            }
+
+            target->Remove();
+
+            REQUIRE( !SearchFiles( GetTmpPath() + "k13.packages*" ) );
+          }
+        }
+        serialized = nullptr;
+        sourceSink = nullptr;
+        targetSink = nullptr;
+
+        RemoveFiles( GetTmpPath() + "k12.*" );
+        RemoveFiles( GetTmpPath() + "k13.*" );
+      }
+      SECTION( "old format bundle files are read and copied" )
+      {
+        auto  legacyPath = GetTmpPath() + "k10.packages";
+        auto  targetPath = GetTmpPath() + "k11.packages";
+        auto  strValues = std::vector<std::string>{ "abc", "", "defg", "" };
+        auto  pointList = std::vector<int64_t>();
+        char  legacyBuf[0x100];
+        char* legacyEnd = legacyBuf;
+        auto  lpfile = (FILE*)nullptr;
+
+      // write the records as the old DumpStore did: length, data[length], and 0 for the empty one
+        for ( auto& next: strValues )
+        {
+          pointList.push_back( legacyEnd - legacyBuf );
+          legacyEnd = ::Serialize( ::Serialize( legacyEnd, next.size() ), next.data(), next.size() );
+        }
+
+        if ( REQUIRE( (lpfile = fopen( legacyPath.c_str(), "wb" )) != nullptr ) )
+        {
+          fwrite( legacyBuf, 1, legacyEnd - legacyBuf, lpfile );
+          fclose( lpfile );
+        }
+        if ( REQUIRE( (lpfile = fopen( targetPath.c_str(), "wb" )) != nullptr ) )
+          fclose( lpfile );
+
+        SECTION( "* the empty bundles of the old files are read by the file-based store" )
+        {
+          auto  dumps = storage::posixFS::CreateDumpStore( mtc::OpenFileStream( legacyPath.c_str(), O_RDONLY ).ptr() );
+
+          for ( size_t i = 0; i != strValues.size(); ++i )
+          {
+            auto  bundle = dumps->Get( pointList[i] );
+
+            if ( REQUIRE( bundle != nullptr ) )
+              REQUIRE( std::string( bundle->GetPtr(), bundle->GetLen() ) == strValues[i] );
+          }
+        }
+        SECTION( "* the empty bundles of the old files are read by the mapped store" )
+        {
+          auto  infile = mtc::OpenFileStream( legacyPath.c_str(), O_RDONLY );
+          auto  mapped = storage::posixFS::CreateDumpStore( infile->MemMap( 0, infile->Size() ).ptr() );
+
+          for ( size_t i = 0; i != strValues.size(); ++i )
+          {
+            auto  bundle = mapped->Get( pointList[i] );
+
+            if ( REQUIRE( bundle != nullptr ) )
+              REQUIRE( std::string( bundle->GetPtr(), bundle->GetLen() ) == strValues[i] );
+          }
+        }
+        SECTION( "* the old files are appended in the old format" )
+        {
+          auto  dumps = storage::posixFS::CreateDumpStore( mtc::OpenFileStream( legacyPath.c_str(), O_RDWR ).ptr(),
+            storage::posixFS::lz_compressed );
+          auto  bundle = mtc::api<const mtc::IByteBuffer>();
+          auto  newpos = dumps->Put( "", 0 );
+
+          REQUIRE( newpos == legacyEnd - legacyBuf );
+
+          if ( REQUIRE( (bundle = dumps->Get( newpos )) != nullptr ) )
+            REQUIRE( bundle->GetLen() == 0 );
+          if ( REQUIRE( (bundle = dumps->Get( pointList[2] )) != nullptr ) )
+            REQUIRE( std::string( bundle->GetPtr(), bundle->GetLen() ) == strValues[2] );
+        }
+        SECTION( "* the old format records are copied to the new format file" )
+        {
+          auto  source = storage::posixFS::CreateDumpStore( mtc::OpenFileStream( legacyPath.c_str(), O_RDONLY ).ptr() );
+          auto  target = storage::posixFS::CreateDumpStore( mtc::OpenFileStream( targetPath.c_str(), O_RDWR ).ptr() );
+          auto  copied = std::vector<int64_t>();
+
+          for ( auto& next: pointList )
+            copied.push_back( target->Copy( *source.ptr(), next ) );
+
+          for ( size_t i = 0; i != strValues.size(); ++i )
+          {
+            auto  bundle = mtc::api<const mtc::IByteBuffer>();
+
+            if ( REQUIRE( copied[i] != -1 ) && REQUIRE( (bundle = target->Get( copied[i] )) != nullptr ) )
+              REQUIRE( std::string( bundle->GetPtr(), bundle->GetLen() ) == strValues[i] );
+          }
+        }
+
+        RemoveFiles( GetTmpPath() + "k10.*" );
+        RemoveFiles( GetTmpPath() + "k11.*" );
+      }
+      SECTION( "revision files are folded to one sorted revision" )
+      {
+        auto  storageSink = mtc::api<IStorage::IIndexStore>();
+        auto  serialized = mtc::api<IStorage::ISerialized>();
+        auto  recorder = PatchRecorder();
+
+        RemoveFiles( GetTmpPath() + "k8.*" );
+
+        if ( REQUIRE_NOTHROW( storageSink = storage::posixFS::CreateSink( storage::posixFS::StoragePolicies::Open( GetTmpPath() + "k8" ) ) )
+          && REQUIRE_NOTHROW( serialized = storageSink->Commit() ) && REQUIRE( serialized != nullptr ) )
+        {
+          auto  patch = mtc::api<IStorage::ISerialized::IPatch>();
+
+          patch = serialized->AddPatch();
+            patch->Update( "a", "1", 1 );
+            patch->Update( "b", "1", 1 );
+          patch = serialized->AddPatch();
+            patch->Delete( "a" );
+            patch->Update( "c", "2", 1 );
+          patch = serialized->AddPatch();
+            patch->Update( "b", "3", 1 );
+            patch->Update( "a", "4", 1 );
+          patch = nullptr;
+
+          SECTION( "* all the revisions are applied in order" )
+          {
+            REQUIRE_NOTHROW( serialized->SetPatch( &recorder ) );
+            REQUIRE( recorder.records == std::vector<std::string>{ "U:a=1", "U:b=1", "D:a", "U:c=2", "U:b=3", "U:a=4" } );
+          }
+          SECTION( "* the folded revision keeps the last state of each entity, the deletion is sticky" )
+          {
+            recorder.records.clear();
+
+            REQUIRE_NOTHROW( serialized->SetPatch( &recorder ) );
+            REQUIRE( recorder.records == std::vector<std::string>{ "D:a", "U:b=3", "U:c=2" } );
+          }
+        }
+        serialized = nullptr;
+        storageSink = nullptr;
+
+        RemoveFiles( GetTmpPath() + "k8.*" );
+      }
+      SECTION( "units may be opened with access hints" )
+      {
+        auto  policies = storage::posixFS::StoragePolicies()
+          .AddPolicy( storage::posixFS::Unit( storage::posixFS::entities | storage::posixFS::bulletin ),
+            storage::posixFS::preloaded, GetTmpPath() + "k9", storage::posixFS::uncompressed, storage::posixFS::huge_pages )
+          .AddPolicy( storage::posixFS::contents, storage::posixFS::memory_mapped, GetTmpPath() + "k9",
+            storage::posixFS::uncompressed, storage::posixFS::Access( storage::posixFS::access_populate | storage::posixFS::huge_pages ) )
+          .AddPolicy( storage::posixFS::linkages, storage::posixFS::memory_mapped, GetTmpPath() + "k9",
+            storage::posixFS::uncompressed, storage::posixFS::access_random )
+          .AddPolicy( storage::posixFS::packages, storage::posixFS::file_based, GetTmpPath() + "k9",
+            storage::posixFS::uncompressed, storage::posixFS::access_willneed );
+        auto  storageSink = mtc::api<IStorage::IIndexStore>();
+        auto  serialized = mtc::api<IStorage::ISerialized>();
+        auto  bundlePos = int64_t(-1);
+
+        RemoveFiles( GetTmpPath() + "k9.*" );
+
+        SECTION( "* the hints are kept by the index instance policies" )
+        {
+          REQUIRE( policies.GetInstance( "0" ).GetPolicy( storage::posixFS::linkages )->access == storage::posixFS::access_random );
+          REQUIRE( policies.GetInstance( "0" ).GetPolicy( storage::posixFS::packages )->access == storage::posixFS::access_willneed );
+        }
+
+        REQUIRE_NOTHROW( storageSink = storage::posixFS::CreateSink( policies ) );
+          storageSink->Entities()->Put( "entities", 8 );
+          storageSink->Contents()->Put( "contents", 8 );
+          storageSink->Linkages()->Put( "linkages", 8 );
+        bundlePos = storageSink->Packages()->Put( "packages", 8 );
+
+        if ( REQUIRE_NOTHROW( serialized = storageSink->Commit() ) && REQUIRE( serialized != nullptr ) )
+        {
+          SECTION( "* the hinted units are read as before" )
+          {
+            auto  linkage = serialized->Linkages()->Get( 0, 8 );
+            auto  package = serialized->Packages()->Get( bundlePos );
+
+            REQUIRE( std::string( serialized->Entities()->GetPtr(), serialized->Entities()->GetLen() ) == "entities" );
+            REQUIRE( std::string( serialized->Contents()->GetPtr(), serialized->Contents()->GetLen() ) == "contents" );
+
+            if ( REQUIRE( linkage != nullptr ) )
+              REQUIRE( std::string( linkage->GetPtr(), linkage->GetLen() ) == "linkages" );
+            if ( REQUIRE( package != nullptr ) )
+              REQUIRE( std::string( package->GetPtr(), package->GetLen() ) == "packages" );
+          }
+        }
+        serialized = nullptr;
+        storageSink = nullptr;
+
+        RemoveFiles( GetTmpPath() + "k9.*" );
+      }
     }
   } );